@@ -0,0 +1,342 @@
+/*
+Compiling: mpicc kmeans_mpi.c -o kmeans_mpi -O3 -march=native -fopenmp -lm
+Executing: time mpirun -np 4 ./kmeans_mpi [-n samples] [-d dimensions] [-k centers] [-steps count] [-weak]
+Options:
+    -n, -d, -k       size of the dataset and number of centers
+                     (default 100000 samples of 1000 dimensions, 100 centers)
+    -steps count     number of K-means steps (default 16)
+    -weak            -n is the number of samples of every rank, for weak
+                     scaling. Otherwise the N samples are split among the
+                     ranks, for strong scaling
+Every rank creates and owns a contiguous shard of the same dataset that
+kmeans_parallel creates (with the generator of common/dataset.h),
+classifies it with OpenMP and the partial center sums and counters
+are combined with MPI_Allreduce. Rank 0 prints the same
+per step differences as kmeans_parallel, then the time per step.
+(Open MPI as root also needs --allow-run-as-root, and more ranks
+than cores need --oversubscribe)
+
+Scaling on a 1-core linux VM, OMP_NUM_THREADS=1, 20000x1000, 100 centers:
+
+strong (-n 20000)        ranks 1: 0.239 s/step   ranks 2: 0.249 s/step   ranks 4: 0.229 s/step
+weak   (-n 5000 -weak)   ranks 1: 0.058 s/step   ranks 2: 0.118 s/step   ranks 4: 0.254 s/step
+
+With a single core the ranks share it, so these numbers only show the
+communication overhead. On a multi-core host or a cluster the strong
+time per step should drop with the ranks and the weak one stay flat.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+#include <omp.h>
+#include "../common/dataset.h"
+
+// *************************************
+// Every sample and center is a row of stride floats, padded with
+// zeros to a multiple of the cache line and 64-byte aligned
+#define ALIGN 64
+#define ROW(a, i) ((a) + (size_t)(i) * stride)
+
+#define STEPS 16 // Default number of K-means steps
+
+// *************************************
+void *allocate(size_t size);
+void createData(void);
+void createCenters(void);
+float classification(void);
+void estimateCenters(void);
+float euclDist(float *a, float *b);
+void usage(char *name);
+
+// *************************************
+long N = 100000; // Number of samples of all the ranks
+int Nv = 1000;   // Number of dimensions
+int Nc = 100;    // Number of centers
+int stride;      // Floats per row
+
+// *************************************
+int rank, ranks; // This rank and the number of ranks
+long first;      // First sample of this rank
+int local;       // Number of samples of this rank
+
+// *************************************
+float *Vec;    // Data of this rank
+float *Center; // Centers array
+int *Classes;  // Classification of the samples of this rank
+
+// Time spent in the steps
+double classifyTime = 0.0, updateTime = 0.0, reduceTime = 0.0;
+
+// *************************************
+// Allocates zeroed, ALIGN aligned memory
+void *allocate(size_t size)
+{
+    size = (size + ALIGN - 1) / ALIGN * ALIGN;
+    void *p = aligned_alloc(ALIGN, size);
+    if (p == NULL)
+    {
+        perror("Unable to allocate memory");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    memset(p, 0, size);
+    return p;
+}
+
+// *************************************
+// Creates the shard of the random data of this rank.
+// The range is (-2, 2) for every dimension.
+// Every value depends only on its global position,
+// so the dataset is the same for any number of ranks.
+void createData(void)
+{
+    int i;
+    Vec = aligned_alloc(ALIGN, (size_t)local * stride * sizeof(float));
+    Classes = malloc(local * sizeof(int));
+    if (Vec == NULL || Classes == NULL)
+    {
+        perror("Unable to allocate the data");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    #pragma omp parallel for schedule(static)
+    for (i = 0; i < local; i++)
+    {
+        float *x = ROW(Vec, i);
+        randomSamples(DATASET_SEED, (size_t)(first + i) * Nv, Nv, x);
+        for (int j = Nv; j < stride; j++)
+            x[j] = 0.0f;
+    }
+}
+
+// *************************************
+// Initializes the centers by choosing random
+// samples from the data. Every rank draws the same
+// samples and the owners contribute their rows.
+void createCenters(void)
+{
+    int i, j;
+    long nc, P[Nc];
+    P[0] = rand() % N;
+    for (i = 1; i < Nc; i++)
+    {
+        do
+        {
+            nc = rand() % N;
+            for (j = 0; j < i; j++)
+            {
+                if (nc == P[j])
+                    break;
+            }
+        } while (j < i);
+        P[i] = nc;
+    }
+    Center = allocate((size_t)Nc * stride * sizeof(float));
+    for (i = 0; i < Nc; i++)
+        if (P[i] >= first && P[i] < first + local)
+            memcpy(ROW(Center, i), ROW(Vec, P[i] - first), sizeof(float) * Nv);
+    MPI_Allreduce(MPI_IN_PLACE, Center, Nc * stride, MPI_FLOAT, MPI_SUM, MPI_COMM_WORLD);
+}
+
+// *************************************
+// Classifies each local sample on the nearest center and
+// then returns the total distance of all the samples
+// of all the ranks from their centers.
+float classification(void)
+{
+    int i;
+    float totaldist = 0.0f;
+    double t = MPI_Wtime();
+    #pragma omp parallel for schedule(static) reduction(+:totaldist)
+    for (i = 0; i < local; i++)
+    {
+        float *x = ROW(Vec, i);
+        float mindist = euclDist(x, Center);
+        int minpos = 0;
+        for (int j = 1; j < Nc; j++)
+        {
+            float dist = euclDist(x, ROW(Center, j));
+            if (dist < mindist)
+            {
+                mindist = dist;
+                minpos = j;
+            }
+        }
+        totaldist += mindist;
+        Classes[i] = minpos;
+    }
+    classifyTime += MPI_Wtime() - t;
+    t = MPI_Wtime();
+    MPI_Allreduce(MPI_IN_PLACE, &totaldist, 1, MPI_FLOAT, MPI_SUM, MPI_COMM_WORLD);
+    reduceTime += MPI_Wtime() - t;
+    return totaldist;
+}
+
+// *************************************
+// Calculates the new centers for the next step.
+// Every thread sums its share of the local samples into a private
+// copy of the centers, the copies are reduced into Center and the
+// sums and counters of all the ranks are combined by MPI_Allreduce.
+void estimateCenters(void)
+{
+    static float *partial = NULL; // Per thread sums
+    static int *partialCount;     // Per thread counters
+    static int *counters;         // Counters of all the ranks
+    static int threads;
+    size_t size = (size_t)Nc * stride;
+    double t = MPI_Wtime();
+    if (partial == NULL)
+    {
+        threads = omp_get_max_threads();
+        partial = aligned_alloc(ALIGN, threads * size * sizeof(float));
+        partialCount = malloc(threads * Nc * sizeof(int));
+        counters = malloc(Nc * sizeof(int));
+        if (partial == NULL || partialCount == NULL || counters == NULL)
+        {
+            perror("Unable to allocate the center sums");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    #pragma omp parallel num_threads(threads)
+    {
+        int t = omp_get_thread_num(), T = omp_get_num_threads();
+        float *sum = partial + t * size;
+        int *count = partialCount + t * Nc;
+        // Cleared by the owner, so the pages are local to it
+        memset(sum, 0, size * sizeof(float));
+        memset(count, 0, Nc * sizeof(int));
+        #pragma omp for schedule(static)
+        for (int i = 0; i < local; i++)
+        {
+            int j = Classes[i];
+            float *s = ROW(sum, j), *x = ROW(Vec, i);
+            count[j]++;
+            #pragma omp simd
+            for (int k = 0; k < Nv; k++)
+                s[k] += x[k];
+        }
+        #pragma omp for schedule(static)
+        for (int i = 0; i < Nc; i++)
+        {
+            float *c = ROW(Center, i);
+            counters[i] = 0;
+            memset(c, 0, Nv * sizeof(float));
+            for (int p = 0; p < T; p++)
+            {
+                float *s = ROW(partial + p * size, i);
+                counters[i] += partialCount[p * Nc + i];
+                #pragma omp simd
+                for (int k = 0; k < Nv; k++)
+                    c[k] += s[k];
+            }
+        }
+    }
+    updateTime += MPI_Wtime() - t;
+    t = MPI_Wtime();
+    MPI_Allreduce(MPI_IN_PLACE, Center, Nc * stride, MPI_FLOAT, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, counters, Nc, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    reduceTime += MPI_Wtime() - t;
+    t = MPI_Wtime();
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < Nc; i++)
+    {
+        float *c = ROW(Center, i);
+        float f = 1.0 / counters[i];
+        #pragma omp simd
+        for (int k = 0; k < Nv; k++)
+            c[k] *= f;
+    }
+    updateTime += MPI_Wtime() - t;
+}
+
+// *************************************
+// Calculates the square of the euclidean distance
+// between two vectors.
+float euclDist(float *a, float *b)
+{
+    int i;
+    float dist = 0.0;
+    #pragma omp simd reduction(+:dist)
+    for (i = 0; i < Nv; i++)
+    {
+        float t = a[i] - b[i];
+        dist += t * t;
+    }
+    return dist;
+}
+
+// *************************************
+// Prints the available options
+void usage(char *name)
+{
+    if (rank == 0)
+        fprintf(stderr, "Usage: %s [-n samples] [-d dimensions] [-k centers] [-steps count] [-weak]\n", name);
+    MPI_Finalize();
+    exit(1);
+}
+
+// *************************************
+int main(int argc, char *argv[])
+{
+    int c = 0, steps = STEPS, weak = 0, provided;
+    float dist, prevdist, dif;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+    // Parse the options
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc && atol(argv[i + 1]) > 0)
+            N = atol(argv[++i]);
+        else if (!strcmp(argv[i], "-d") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            Nv = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-k") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            Nc = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-steps") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            steps = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-weak"))
+            weak = 1;
+        else
+            usage(argv[0]);
+    }
+    if (weak)
+        N *= ranks;
+    if (Nc > N || N / ranks + 1 > 0x7fffffff)
+        usage(argv[0]);
+    stride = (Nv * sizeof(float) + ALIGN - 1) / ALIGN * ALIGN / sizeof(float);
+    // The shard of this rank
+    first = N * rank / ranks;
+    local = N * (rank + 1) / ranks - first;
+    // Initialize data
+    createData();
+    createCenters();
+    // First classification
+    dist = classification();
+    MPI_Barrier(MPI_COMM_WORLD);
+    double start = MPI_Wtime();
+    // The K-means steps
+    do
+    {
+        estimateCenters();
+        prevdist = dist;
+        dist = classification();
+        dif = prevdist - dist;
+        c++;
+        if (rank == 0)
+            printf("%f\n", dif);
+    } while (c < steps);
+    MPI_Barrier(MPI_COMM_WORLD);
+    double total = MPI_Wtime() - start;
+    // The slowest rank sets the pace
+    double times[3] = {classifyTime, updateTime, reduceTime};
+    MPI_Reduce(rank == 0 ? MPI_IN_PLACE : times, times, 3, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    if (rank == 0)
+    {
+        printf("%s scaling: %d ranks x %d threads, %ld samples (%ld per rank)\n",
+               weak ? "Weak" : "Strong", ranks, omp_get_max_threads(), N, N / ranks);
+        printf("Time per step: %.3f s (classification %.3f s, update %.3f s, allreduce %.3f s)\n",
+               total / steps, times[0] / (steps + 1), times[1] / steps, times[2] / steps);
+    }
+    MPI_Finalize();
+    return 0;
+}
@@ -1,7 +1,100 @@
 /* 
-Compiling: gcc kmeans_parallel.c -o kmeans_parallel -O3 -fopenmp
-Executing: time ./kmeans_parallel
-Time of execution:
+Compiling: gcc kmeans_parallel.c -o kmeans_parallel -O3 -march=native -fopenmp -lm
+Executing: time ./kmeans_parallel [-n samples] [-d dimensions] [-k centers] [-seed value]
+                                  [-assign naive|hamerly|gemm|pds [-reorder]]
+                                  [-assign approx [-projdim count] [-shortlist count]]
+                                  [-data file [-chunk samples]] [-write file]
+                                  [-batch size [-movetol distance]] [-init random|parallel]
+                                  [-steps count] [-tol fraction] [-moved count] [-incremental]
+                                  [-precision fp32|fp16|int8 [-check]] [-restarts count]
+                                  [-save model]
+           ./kmeans_parallel -predict model [-input file] [-output file] [-assign naive|gemm]
+Options:
+    -n, -d, -k       size of the created dataset and number of centers
+                     (default 100000 samples of 1000 dimensions, 100 centers)
+    -seed value      seed of the created dataset (default DATASET_SEED). The
+                     samples come from the generator of common/dataset.h and
+                     are the same for any number of threads
+    -assign naive    full search over every center (default)
+    -assign hamerly  skips the search for samples whose nearest center
+                     provably did not change and reports the skipped
+                     distance evaluations per step
+    -assign gemm     cache blocked ||x||^2 - 2x.c + ||c||^2 kernel, using
+                     AVX-512 or AVX2 when compiled for them (-march=native).
+                     Samples almost equally close to two centers may be
+                     classified differently than with the other modes
+    -assign pds      partial distance search: the distance is summed in blocks
+                     of PDS_BLOCK dimensions and abandoned as soon as it passes
+                     the nearest center so far, starting from the center of
+                     the previous step. Reports the dimensions summed per
+                     distance. As with gemm, the sums are rounded in another
+                     order, so almost equally close samples may differ
+    -reorder         with pds, sums first the blocks of dimensions where the
+                     centers of the step vary the most
+    -assign approx   approximate search: the samples (once) and the centers
+                     (every step) are projected on -projdim random +-1 axes
+                     (default PROJ_DIM) and only the -shortlist centers
+                     (default SHORTLIST) nearest in the projection get an
+                     exact distance. A longer shortlist or more axes find the
+                     nearest center more often but cost more. Reports the
+                     samples whose nearest projected center was not the
+                     nearest one of the shortlist, and with -check the
+                     samples classified differently than the full search
+    -data file       memory maps a dataset file (common/dataset.h, written by
+                     -write or mkdataset) instead of creating the dataset, and
+                     processes it in chunks, prefetching the next chunk while
+                     the current one is computed. Its size replaces -n and -d
+    -chunk samples   samples per chunk of -data (default CHUNK_BYTES worth)
+    -write file      writes the created dataset to a binary file and exits
+    -batch size      mini-batch K-means instead of the 16 full steps. Every
+                     step assigns a random batch of samples in parallel and
+                     moves each center towards its samples with a per center
+                     learning rate of 1/(samples it has absorbed). Stops when
+                     no center moves more than -movetol (default MOVE_TOL)
+                     or after MB_STEPS steps, then reports the total distance
+    -init random     initial centers are random samples (default)
+    -init parallel   k-means|| seeding: KMPP_ROUNDS rounds pick every sample
+                     with probability KMPP_FACTOR*Nc*d^2/(total d^2) in
+                     parallel, then weighted k-means++ reduces the picked
+                     candidates to Nc centers
+    -steps count     maximum number of K-means steps (default 16)
+    -tol fraction    stops when the total distance drops by less than this
+                     fraction of its previous value
+    -moved count     stops when at most this many samples changed center
+    -incremental     keeps the sums of every cluster and only adds or removes
+                     the samples that changed center, instead of summing
+                     every sample in every step
+    -precision fp16  after the initial centers are chosen, the samples are
+    -precision int8  kept as fp16 or as int8 with a scale per sample (half or
+                     a quarter of the bytes per step). Every kernel converts
+                     a sample to fp32 in a small buffer and computes in fp32.
+                     With -data the reduced copy is held in memory
+    -check           also keeps the fp32 samples and reports how many samples
+                     the reduced precision classifies differently in every step
+                     (or -assign approx, without reduced precision)
+    -restarts count  trains count sets of centers, each with its own seeding,
+                     and keeps the one with the lowest total distance. Every
+                     pass over the samples classifies and sums every sample
+                     for all the sets, so they share the reading of the data.
+                     Runs -steps steps with the full search of -assign naive
+                     and prints the distance drop of every set in each step.
+                     -assign other than naive, -check, -tol, -moved, -batch
+                     and -incremental are rejected
+    -save model      writes the final centers to a model file: a MODEL header
+                     and the centers as rows of dimensions floats
+    -predict model   loads the centers of a model file instead of training and
+                     classifies the samples of a dataset file (-input, default
+                     the standard input, "-") in batches of PREDICT_BATCH.
+                     A second thread reads the next batch while the current
+                     one is classified. The class of every sample is written
+                     as an int32 to -output (default the standard output) and
+                     the throughput is reported on the standard error.
+                     A dataset header with 0 samples reads until end of file.
+                     A stream that ends before its samples, or in a partial
+                     row, is reported as truncated.
+                     Only -assign naive or gemm apply; -precision, -check,
+                     -restarts, -batch and -incremental are rejected
+Time of execution (naive):
 
 real    0m9,595s
 user    0m58,986s
@@ -11,34 +104,463 @@ sys     0m0,188s
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
 #include <omp.h>
+#include "../common/dataset.h"
+#if defined(__AVX512F__) || (defined(__AVX2__) && defined(__FMA__)) || defined(__F16C__)
+#include <immintrin.h>
+#endif
 
 // *************************************
-#define N 100000 // Number of samples
-#define Nv 1000  // Number of dimensions
-#define Nc 100   // Number of centers
+// Every sample and center is a row of stride floats, padded with
+// zeros to a multiple of the cache line and 64-byte aligned
+#define ALIGN 64
+#define ROW(a, i) ((a) + (size_t)(i) * stride)
+
+// Dataset files of DATASET_FLOAT rows, see common/dataset.h
+#define CHUNK_BYTES (256L << 20) // Default chunk size of mapped datasets
+
+// Binary model files: a MODEL header, then the centers as
+// rows of dims floats starting at MODEL_OFFSET
+#define MODEL_MAGIC "KMEANSMD"
+#define MODEL_VERSION 1
+#define MODEL_OFFSET 64
+#define PREDICT_BATCH 8192 // Samples classified at once by -predict
+
+// Mini-batch parameters
+#define MB_STEPS 10000 // Maximum number of mini-batch steps
+#define MOVE_TOL 1e-3f // Default center movement that stops the steps
+
+#define STEPS 16 // Default number of K-means steps
+
+// Center sums: every partial sum adds the blocks p, p + SUM_PARTS, ...
+// of SUM_BLOCK samples, so the sums do not depend on the threads
+#define SUM_PARTS 32  // Partial sums of the centers
+#define SUM_BLOCK 256 // Samples per block of a partial sum
+
+// Storage of the samples
+#define PREC_FP32 0 // Vec
+#define PREC_FP16 1 // Vec16
+#define PREC_INT8 2 // Vec8, times Scale of the sample
+
+// k-means|| parameters
+#define KMPP_ROUNDS 5 // Oversampling rounds
+#define KMPP_FACTOR 2 // Expected candidates per round, in multiples of Nc
+
+// Assignment step variants
+#define ASSIGN_NAIVE 0   // Full search over every center
+#define ASSIGN_HAMERLY 1 // Full search only when the bounds fail
+#define ASSIGN_GEMM 2    // Blocked dot product kernel
+#define ASSIGN_PDS 3     // Partial distance search
+#define BOUND_EPS 1e-4f  // Relative slack of the bounds against rounding
+#define PDS_BLOCK 64     // Dimensions summed between the checks of pds, which
+                         // cost a horizontal sum, so four AVX-512 registers
+#define PDS_BLOCKS ((stride + PDS_BLOCK - 1) / PDS_BLOCK) // Blocks of a row
+#define ASSIGN_APPROX 4  // Exact distances only for a shortlist of centers
+#define PROJ_DIM 32      // Default dimensions of the approx projection
+#define SHORTLIST 4      // Default centers of the approx shortlist
+
+// Blocking of the GEMM kernel. A CB x KB tile of centers stays
+// in L1 while the SB x KB tile of samples is streamed from L2.
+#define SB 64  // Samples per block
+#define CB 20  // Centers per block
+#define KB 256 // Dimensions per block
+
+// Register blocking of the micro-kernel (samples x centers)
+#if defined(__AVX512F__)
+#define MR 4
+#define NR 4
+#else
+#define MR 4
+#define NR 2
+#endif
+
+typedef struct model{
+    char magic[8];    // MODEL_MAGIC
+    uint32_t version; // MODEL_VERSION
+    uint32_t dims;    // Dimensions of every center
+    uint32_t centers; // Number of centers
+} MODEL;
+
+// A batch of samples read by the predict mode
+typedef struct batch{
+    FILE *fp;     // Input stream
+    long *left;   // Samples still to be read from fp
+    int *partial; // Set when fp ends in a partial row
+    float *rows;  // PREDICT_BATCH padded rows
+    int count;    // Samples read into rows
+} BATCH;
 
 // *************************************
+void allocateCenters(void);
+void *allocate(size_t size);
 void createData(void);
+void loadData(char *path);
+void writeData(char *path);
+void saveModel(char *path);
+void loadModel(char *path);
+void predict(char *modelPath, char *inPath, char *outPath);
+void *readBatch(void *arg);
 void createCenters(void);
+void createCentersParallel(void);
+float hashUniform(unsigned long a, unsigned long b);
+void prefetchChunk(int start);
+void releaseChunk(int start);
 float classification(void);
+float classifyNaive(int start, int end);
+int nearestCenter(float *x, float *mindist);
+void hamerlyBounds(void);
+float classifyHamerly(int start, int end);
+float classifyGemm(int start, int end);
+float classifyPds(int start, int end);
+float partialDist(float *a, float *b, float limit, long *dims);
+void orderBlocks(void);
+void projectCenters(void);
+float classifyApprox(int start, int end);
+void microKernel(float *x, float *c, int k0, int k1, float *dot);
 void estimateCenters(void);
+void classifyRestarts(float *totaldist);
+float multiRestart(int steps);
+void updateCenters(void);
+int miniBatch(int batch, float tol);
 float euclDist(float *a, float *b);
+float dotProduct(float *a, float *b);
+void quantizeData(void);
+float *sample(int i, float *buf);
+long checkPrecision(void);
+void usage(char *name);
 
 // *************************************
-float Vec[N][Nv];     // Data array
-float Center[Nc][Nv]; // Centers array
-int Classes[N];       // Classification array
+int N = 100000; // Number of samples
+int Nv = 1000;  // Number of dimensions
+int Nc = 100;   // Number of centers
+int stride;     // Floats per row
+unsigned long dataSeed = DATASET_SEED; // Seed of the created dataset
+
+// *************************************
+float *Vec;    // Data array
+float *Center; // Centers array
+int *Classes;  // Classification array
+
+// Reduced precision copies of the data
+int precision = PREC_FP32;
+_Float16 *Vec16; // fp16 samples
+int8_t *Vec8;    // int8 samples
+float *Scale;    // Scale of every int8 sample
+
+// Chunked processing of mapped datasets
+int chunk;              // Samples per chunk
+int mapped = 0;         // Whether Vec is a mapped file
+size_t mappedSize;      // Bytes of the mapping
+
+// Hamerly state, kept across the steps
+float *Lower;     // Lower bound of the distance to the second nearest center
+float *OldCenter; // Centers of the previous classification
+float *Half;      // Half the distance to the nearest other center
+float maxDrift;   // Largest center movement since the previous step
+int bounded = 0;  // Whether Lower and OldCenter are valid
+int prune;        // Whether the bounds can be used in this step
+
+// GEMM state
+float *CenterNorm; // Squared norms of the centers
+
+// Partial distance search state
+int *BlockOrder;  // Order in which the blocks of dimensions are summed
+float *BlockVar;  // Variance of the centers in every block
+int reorder = 0;  // Whether BlockOrder follows BlockVar
+long touched = 0; // Dimensions summed by the last classification
+long computed = 0; // Distances started by the last classification
+
+// Approximate search state
+int projDim = PROJ_DIM;     // Dimensions of the projection
+int shortlist = SHORTLIST;  // Centers measured exactly per sample
+float *Proj;                // projDim random axes, rows of stride floats
+float *ProjVec;             // Projected samples, rows of projDim floats
+float *ProjCenter;          // Projected centers, rows of projDim floats
+int projected = 0;          // Whether ProjVec holds every sample
+long approxMiss = 0;        // Samples whose projected winner was not the nearest
+
+// Multiple restarts. Center holds the restarts sets of Nc centers
+// one after the other and Classes the restarts sets of N classes.
+int restarts = 1;
+
+int assignMode = ASSIGN_NAIVE; // Selected assignment step
+long skipped = 0;              // Distances skipped by the last classification
+long reassigned = 0;           // Samples that changed center in the last classification
+
+// *************************************
+// Allocates zeroed, ALIGN aligned memory
+void *allocate(size_t size)
+{
+    size = (size + ALIGN - 1) / ALIGN * ALIGN;
+    void *p = aligned_alloc(ALIGN, size);
+    if (p == NULL)
+    {
+        perror("Unable to allocate memory");
+        exit(1);
+    }
+    memset(p, 0, size);
+    return p;
+}
+
+// *************************************
+// Allocates the centers and the per center state
+void allocateCenters(void)
+{
+    Center = allocate((size_t)restarts * Nc * stride * sizeof(float));
+    OldCenter = allocate(Nc * stride * sizeof(float));
+    Half = allocate(Nc * sizeof(float));
+    CenterNorm = allocate(Nc * sizeof(float));
+    BlockOrder = allocate(PDS_BLOCKS * sizeof(int));
+    BlockVar = allocate(PDS_BLOCKS * sizeof(float));
+    for (int b = 0; b < PDS_BLOCKS; b++)
+        BlockOrder[b] = b;
+}
 
 // *************************************
 // Creates random data.
-// The range is (-2, 2) for every dimension
+// The range is (-2, 2) for every dimension.
+// Every value depends only on its position, so the data is filled
+// in parallel with the static schedule of the classification and
+// every page is first touched by the thread that later reads it.
 void createData(void)
 {
-    int i, j;
+    int i;
+    size_t size = (size_t)N * stride * sizeof(float);
+    Vec = aligned_alloc(ALIGN, size);
+    if (Vec == NULL)
+    {
+        perror("Unable to allocate the data");
+        exit(1);
+    }
+    #pragma omp parallel for schedule(static)
+    for (i = 0; i < N; i++)
+    {
+        float *x = ROW(Vec, i);
+        randomSamples(dataSeed, (size_t)i * Nv, Nv, x);
+        for (int j = Nv; j < stride; j++)
+            x[j] = 0.0f;
+    }
+}
+
+// *************************************
+// Converts the data to the selected precision, in parallel
+// with the static schedule, so every thread first touches
+// the reduced samples it later reads
+void quantizeData(void)
+{
+    int i;
+    size_t size = (size_t)N * stride;
+    if (precision == PREC_FP16)
+        Vec16 = aligned_alloc(ALIGN, size * sizeof(_Float16));
+    else
+    {
+        Vec8 = aligned_alloc(ALIGN, (size + ALIGN - 1) / ALIGN * ALIGN);
+        Scale = malloc(N * sizeof(float));
+    }
+    if (Vec16 == NULL && (Vec8 == NULL || Scale == NULL))
+    {
+        perror("Unable to allocate the reduced data");
+        exit(1);
+    }
+    #pragma omp parallel for schedule(static)
+    for (i = 0; i < N; i++)
+    {
+        float *x = ROW(Vec, i);
+        if (precision == PREC_FP16)
+        {
+            _Float16 *q = ROW(Vec16, i);
+            for (int k = 0; k < stride; k++)
+                q[k] = k < Nv ? x[k] : 0;
+            continue;
+        }
+        int8_t *q = ROW(Vec8, i);
+        float max = 0.0f;
+        for (int k = 0; k < Nv; k++)
+            if (fabsf(x[k]) > max)
+                max = fabsf(x[k]);
+        Scale[i] = max / 127;
+        float f = max > 0.0f ? 127 / max : 0.0f;
+        for (int k = 0; k < stride; k++)
+            q[k] = k < Nv ? (int8_t)lrintf(x[k] * f) : 0;
+    }
+}
+
+// *************************************
+// Returns sample i as floats. When the data is kept
+// with less precision, it is converted into buf,
+// which must have room for stride floats.
+float *sample(int i, float *buf)
+{
+    if (precision == PREC_FP16)
+    {
+        _Float16 *q = ROW(Vec16, i);
+        int k = 0;
+        // The rows are padded to 16 values
+#if defined(__AVX512F__)
+        for (; k < stride; k += 16)
+            _mm512_storeu_ps(buf + k, _mm512_cvtph_ps(_mm256_load_si256((__m256i *)(q + k))));
+#elif defined(__F16C__)
+        for (; k < stride; k += 8)
+            _mm256_storeu_ps(buf + k, _mm256_cvtph_ps(_mm_load_si128((__m128i *)(q + k))));
+#endif
+        for (; k < stride; k++)
+            buf[k] = q[k];
+        return buf;
+    }
+    if (precision == PREC_INT8)
+    {
+        int8_t *q = ROW(Vec8, i);
+        float s = Scale[i];
+        #pragma omp simd
+        for (int k = 0; k < stride; k++)
+            buf[k] = s * q[k];
+        return buf;
+    }
+    return ROW(Vec, i);
+}
+
+// *************************************
+// Counts the samples that the full precision data
+// would classify on a different center
+long checkPrecision(void)
+{
+    int i;
+    long diff = 0;
+    #pragma omp parallel for schedule(static) reduction(+:diff)
     for (i = 0; i < N; i++)
-        for (j = 0; j < Nv; j++)
-            Vec[i][j] = 4 * (rand() / (float)RAND_MAX - 0.5);
+    {
+        float mindist;
+        diff += nearestCenter(ROW(Vec, i), &mindist) != Classes[i];
+    }
+    return diff;
+}
+
+// *************************************
+// Maps a binary dataset file as the data array
+void loadData(char *path)
+{
+    DATASET *head = mapDataset(path, DATASET_FLOAT, &mappedSize);
+    if (head->stride % (ALIGN / sizeof(float)))
+    {
+        fprintf(stderr, "%s: rows not padded to %d bytes\n", path, ALIGN);
+        exit(1);
+    }
+    if (head->rows < (uint64_t)Nc || head->rows > INT32_MAX)
+    {
+        fprintf(stderr, "%s: bad number of samples\n", path);
+        exit(1);
+    }
+    N = head->rows;
+    Nv = head->dims;
+    stride = head->stride;
+    dataSeed = head->seed;
+    Vec = DATASET_ROWS(head);
+    mapped = 1;
+}
+
+// *************************************
+// Writes the data array to a binary dataset file
+void writeData(char *path)
+{
+    DATASET head = {.type = DATASET_FLOAT, .rows = N, .dims = Nv, .stride = stride, .seed = dataSeed};
+    writeDataset(path, head, Vec);
+}
+
+// *************************************
+// Writes the centers to a binary model file
+void saveModel(char *path)
+{
+    char pad[MODEL_OFFSET] = {0};
+    MODEL head = {MODEL_MAGIC, MODEL_VERSION, Nv, Nc};
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL)
+    {
+        perror("Unable to create the model");
+        exit(1);
+    }
+    memcpy(pad, &head, sizeof(head));
+    int fail = fwrite(pad, 1, MODEL_OFFSET, fp) != MODEL_OFFSET;
+    for (int j = 0; j < Nc && !fail; j++)
+        fail = fwrite(ROW(Center, j), sizeof(float), Nv, fp) != (size_t)Nv;
+    if (fail || fclose(fp))
+    {
+        perror("Unable to write the model");
+        exit(1);
+    }
+}
+
+// *************************************
+// Reads the centers of a binary model file.
+// Replaces Nv and Nc and allocates the centers.
+void loadModel(char *path)
+{
+    char pad[MODEL_OFFSET];
+    MODEL head;
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        perror("Unable to open the model");
+        exit(1);
+    }
+    if (fread(pad, 1, MODEL_OFFSET, fp) != MODEL_OFFSET)
+    {
+        fprintf(stderr, "%s: not a model file\n", path);
+        exit(1);
+    }
+    memcpy(&head, pad, sizeof(head));
+    if (memcmp(head.magic, MODEL_MAGIC, 8) || head.version != MODEL_VERSION ||
+        head.dims == 0 || head.dims > INT32_MAX / 2 || head.centers == 0 || head.centers > INT32_MAX)
+    {
+        fprintf(stderr, "%s: not a version %d model file\n", path, MODEL_VERSION);
+        exit(1);
+    }
+    Nv = head.dims;
+    Nc = head.centers;
+    stride = (Nv * sizeof(float) + ALIGN - 1) / ALIGN * ALIGN / sizeof(float);
+    allocateCenters();
+    for (int j = 0; j < Nc; j++)
+        if (fread(ROW(Center, j), sizeof(float), Nv, fp) != (size_t)Nv)
+        {
+            fprintf(stderr, "%s: truncated model file\n", path);
+            exit(1);
+        }
+    fclose(fp);
+}
+
+// *************************************
+// Asks the kernel to start reading the chunk starting
+// at sample start, while the previous one is computed
+void prefetchChunk(int start)
+{
+    if (!mapped || precision != PREC_FP32 || start >= N)
+        return;
+    int end = start + chunk < N ? start + chunk : N;
+    long page = sysconf(_SC_PAGESIZE);
+    uintptr_t from = (uintptr_t)ROW(Vec, start) & ~(page - 1);
+    madvise((void *)from, (uintptr_t)ROW(Vec, end) - from, MADV_WILLNEED);
+}
+
+// *************************************
+// Drops the pages of the chunk starting at sample start,
+// so only a couple of chunks stay resident
+void releaseChunk(int start)
+{
+    if (!mapped || precision != PREC_FP32 || chunk >= N)
+        return;
+    int end = start + chunk < N ? start + chunk : N;
+    long page = sysconf(_SC_PAGESIZE);
+    uintptr_t from = ((uintptr_t)ROW(Vec, start) + page - 1) & ~(page - 1);
+    uintptr_t to = (uintptr_t)ROW(Vec, end) & ~(page - 1);
+    if (to > from)
+        madvise((void *)from, to - from, MADV_DONTNEED);
 }
 
 // *************************************
@@ -62,63 +584,1155 @@ void createCenters(void)
         P[i] = nc;
     }
     for (i = 0; i < Nc; i++)
-        memcpy(Center[i], Vec[P[i]], sizeof(float) * Nv);
+        memcpy(ROW(Center, i), ROW(Vec, P[i]), sizeof(float) * Nv);
+}
+
+// *************************************
+// Initializes the centers with k-means|| seeding.
+// Every round picks each sample with probability proportional to
+// its squared distance from the candidates so far, all in parallel.
+// The candidates are weighted by the samples nearest to them and
+// k-means++ on them chooses the Nc centers.
+void createCentersParallel(void)
+{
+    int i, ncand = 0, cap = 2 * KMPP_ROUNDS * KMPP_FACTOR * Nc + Nc;
+    int *cand = malloc(cap * sizeof(int)), *nearest = malloc(N * sizeof(int));
+    float *mindist = malloc(N * sizeof(float));
+    char *picked = malloc(N);
+    unsigned long seed = rand();
+    float cost = 0.0f;
+    if (cand == NULL || nearest == NULL || mindist == NULL || picked == NULL)
+    {
+        perror("Unable to allocate the candidates");
+        exit(1);
+    }
+    cand[ncand++] = rand() % N;
+    #pragma omp parallel for reduction(+:cost)
+    for (i = 0; i < N; i++)
+    {
+        mindist[i] = euclDist(ROW(Vec, i), ROW(Vec, cand[0]));
+        nearest[i] = 0;
+        cost += mindist[i];
+    }
+    for (int round = 0; round < KMPP_ROUNDS && cost > 0.0f; round++)
+    {
+        int from = ncand;
+        float l = KMPP_FACTOR * Nc;
+        // The random numbers depend only on the round and the sample,
+        // so the picks do not depend on the number of threads
+        #pragma omp parallel for
+        for (i = 0; i < N; i++)
+            picked[i] = hashUniform(seed + round, i) * cost < l * mindist[i];
+        for (i = 0; i < N; i++)
+        {
+            if (!picked[i])
+                continue;
+            if (ncand == cap)
+            {
+                cap *= 2;
+                cand = realloc(cand, cap * sizeof(int));
+                if (cand == NULL)
+                {
+                    perror("Unable to allocate the candidates");
+                    exit(1);
+                }
+            }
+            cand[ncand++] = i;
+        }
+        cost = 0.0f;
+        #pragma omp parallel for reduction(+:cost)
+        for (i = 0; i < N; i++)
+        {
+            for (int c = from; c < ncand; c++)
+            {
+                float dist = euclDist(ROW(Vec, i), ROW(Vec, cand[c]));
+                if (dist < mindist[i])
+                {
+                    mindist[i] = dist;
+                    nearest[i] = c;
+                }
+            }
+            cost += mindist[i];
+        }
+    }
+
+    // Weight of every candidate
+    float *weight = calloc(ncand, sizeof(float)), *canddist = malloc(ncand * sizeof(float));
+    int chosen[Nc], nchosen = 0;
+    if (weight == NULL || canddist == NULL)
+    {
+        perror("Unable to allocate the candidates");
+        exit(1);
+    }
+    for (i = 0; i < N; i++)
+        weight[nearest[i]]++;
+    for (int c = 0; c < ncand; c++)
+        canddist[c] = INFINITY;
+
+    // Weighted k-means++ on the candidates
+    while (nchosen < Nc && nchosen < ncand)
+    {
+        int next = -1;
+        double total = 0.0, sum = 0.0, r;
+        for (int c = 0; c < ncand; c++)
+            if (canddist[c] > 0.0f)
+                total += nchosen ? weight[c] * canddist[c] : weight[c];
+        r = rand() / ((double)RAND_MAX + 1) * total;
+        for (int c = 0; c < ncand; c++)
+        {
+            if (canddist[c] == 0.0f)
+                continue;
+            if (next < 0)
+                next = c; // Fallback when every weight is zero
+            sum += nchosen ? weight[c] * canddist[c] : weight[c];
+            if (sum > r)
+            {
+                next = c;
+                break;
+            }
+        }
+        if (next < 0)
+            break; // Every candidate coincides with a chosen one
+        chosen[nchosen++] = next;
+        #pragma omp parallel for
+        for (int c = 0; c < ncand; c++)
+        {
+            float dist = euclDist(ROW(Vec, cand[c]), ROW(Vec, cand[next]));
+            if (dist < canddist[c])
+                canddist[c] = dist;
+        }
+    }
+    for (i = 0; i < nchosen; i++)
+        memcpy(ROW(Center, i), ROW(Vec, cand[chosen[i]]), sizeof(float) * Nv);
+    // Too few candidates, fill in with random samples
+    for (; i < Nc; i++)
+        memcpy(ROW(Center, i), ROW(Vec, rand() % N), sizeof(float) * Nv);
+    free(cand);
+    free(nearest);
+    free(mindist);
+    free(picked);
+    free(weight);
+    free(canddist);
+}
+
+// *************************************
+// Returns a uniform number in [0, 1) that depends
+// only on a and b (splitmix64 finalizer)
+float hashUniform(unsigned long a, unsigned long b)
+{
+    unsigned long z = a * 0x9E3779B97F4A7C15UL + b + 1;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9UL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBUL;
+    z ^= z >> 31;
+    return (z >> 40) * (1.0f / (1 << 24));
 }
 
 // *************************************
 // Classifies each sample on the nearest center and
 // then returns the total distance of all the samples
-// from their centers.
+// from their centers. The samples are processed
+// in chunks, using the selected assignment step.
 float classification(void)
+{
+    float totaldist = 0.0f;
+    skipped = 0;
+    reassigned = 0;
+    touched = 0;
+    computed = 0;
+    approxMiss = 0;
+    if (assignMode == ASSIGN_HAMERLY)
+        hamerlyBounds();
+    if (assignMode == ASSIGN_PDS && reorder)
+        orderBlocks();
+    if (assignMode == ASSIGN_APPROX)
+        projectCenters();
+    if (assignMode == ASSIGN_GEMM)
+        for (int j = 0; j < Nc; j++)
+            CenterNorm[j] = dotProduct(ROW(Center, j), ROW(Center, j));
+    for (int start = 0; start < N; start += chunk)
+    {
+        int end = start + chunk < N ? start + chunk : N;
+        prefetchChunk(end);
+        if (assignMode == ASSIGN_HAMERLY)
+            totaldist += classifyHamerly(start, end);
+        else if (assignMode == ASSIGN_GEMM)
+            totaldist += classifyGemm(start, end);
+        else if (assignMode == ASSIGN_PDS)
+            totaldist += classifyPds(start, end);
+        else if (assignMode == ASSIGN_APPROX)
+            totaldist += classifyApprox(start, end);
+        else
+            totaldist += classifyNaive(start, end);
+        releaseChunk(start);
+    }
+    projected = assignMode == ASSIGN_APPROX;
+    if (assignMode == ASSIGN_HAMERLY)
+    {
+        memcpy(OldCenter, Center, Nc * stride * sizeof(float));
+        bounded = 1;
+    }
+    return totaldist;
+}
+
+// *************************************
+// Classifies the samples [start, end) with a full
+// search and returns their total distance
+float classifyNaive(int start, int end)
 {
     int i;
     float totaldist = 0.0f;
-	#pragma omp parallel for reduction(+:totaldist)	
-    for (i = 0; i < N; i++)
+    long moved = 0;
+    #pragma omp parallel
     {
-        float mindist = euclDist(Vec[i], Center[0]);
-        int minpos = 0;
-        for (int j = 1; j < Nc; j++)
+        // Reduced precision samples are converted in a buffer of every thread
+        float *buf = precision == PREC_FP32 ? NULL : allocate(stride * sizeof(float));
+        #pragma omp for schedule(static) reduction(+:totaldist, moved)
+        for (i = start; i < end; i++)
         {
-            float dist = euclDist(Vec[i], Center[j]);
-            if (dist < mindist)
+            float mindist;
+            int minpos = nearestCenter(sample(i, buf), &mindist);
+            moved += minpos != Classes[i];
+            Classes[i] = minpos;
+            totaldist += mindist;
+        }
+        free(buf);
+    }
+    reassigned += moved;
+    return totaldist;
+}
+
+// *************************************
+// Classifies the samples [start, end) with a partial
+// distance search and returns their total distance.
+// The center of the previous step is measured first,
+// so that the other distances are abandoned early.
+float classifyPds(int start, int end)
+{
+    float totaldist = 0.0f;
+    long moved = 0, dims = 0;
+    #pragma omp parallel
+    {
+        // Reduced precision samples are converted in an aligned
+        // buffer of every thread, as partialDist expects
+        float *buf = precision == PREC_FP32 ? NULL : allocate(stride * sizeof(float));
+        #pragma omp for schedule(static) reduction(+:totaldist, moved, dims)
+        for (int i = start; i < end; i++)
+        {
+            float *x = sample(i, buf);
+            int first = Classes[i] >= 0 ? Classes[i] : 0, minpos = first;
+            float mindist = partialDist(x, ROW(Center, first), INFINITY, &dims);
+            for (int j = 0; j < Nc; j++)
+            {
+                if (j == first)
+                    continue;
+                float dist = partialDist(x, ROW(Center, j), mindist, &dims);
+                if (dist < mindist)
+                {
+                    mindist = dist;
+                    minpos = j;
+                }
+            }
+            moved += minpos != Classes[i];
+            Classes[i] = minpos;
+            totaldist += mindist;
+        }
+        free(buf);
+    }
+    reassigned += moved;
+    touched += dims;
+    computed += (long)(end - start) * Nc;
+    return totaldist;
+}
+
+// *************************************
+// Sums the square of the euclidean distance block
+// by block, in the order of BlockOrder, and stops
+// as soon as it reaches limit. Adds the summed
+// dimensions to dims.
+float partialDist(float *a, float *b, float limit, long *dims)
+{
+    float dist = 0.0f;
+    int k, n = 0, blocks = PDS_BLOCKS;
+    for (k = 0; k < blocks && dist < limit; k++)
+    {
+        int d = BlockOrder[k] * PDS_BLOCK, len = stride - d < PDS_BLOCK ? stride - d : PDS_BLOCK;
+        float part = 0.0f, *x = a + d, *c = b + d;
+        #pragma omp simd reduction(+:part) aligned(x, c : ALIGN)
+        for (int j = 0; j < len; j++)
+        {
+            float t = x[j] - c[j];
+            part += t * t;
+        }
+        dist += part;
+        n += len;
+    }
+    *dims += n < Nv ? n : Nv;
+    return dist;
+}
+
+// Orders the blocks of dimensions by decreasing BlockVar
+int compareBlocks(const void *a, const void *b)
+{
+    float va = BlockVar[*(const int *)a], vb = BlockVar[*(const int *)b];
+    return (va < vb) - (va > vb);
+}
+
+// *************************************
+// Puts first the blocks of dimensions where the centers
+// differ the most, as they pass the limit the soonest
+void orderBlocks(void)
+{
+    int blocks = PDS_BLOCKS;
+    #pragma omp parallel for schedule(static)
+    for (int b = 0; b < blocks; b++)
+    {
+        float var = 0.0f;
+        for (int d = b * PDS_BLOCK; d < (b + 1) * PDS_BLOCK && d < stride; d++)
+        {
+            float mean = 0.0f, sq = 0.0f;
+            for (int j = 0; j < Nc; j++)
+            {
+                mean += ROW(Center, j)[d];
+                sq += ROW(Center, j)[d] * ROW(Center, j)[d];
+            }
+            mean /= Nc;
+            var += sq / Nc - mean * mean;
+        }
+        BlockVar[b] = var;
+        BlockOrder[b] = b;
+    }
+    qsort(BlockOrder, blocks, sizeof(int), compareBlocks);
+}
+
+// *************************************
+// Projects the centers on the random axes, creating
+// the axes and the projected samples the first time
+void projectCenters(void)
+{
+    if (Proj == NULL)
+    {
+        unsigned long seed = rand();
+        float f = 1.0f / sqrtf(projDim);
+        Proj = allocate((size_t)projDim * stride * sizeof(float));
+        ProjVec = allocate((size_t)N * projDim * sizeof(float));
+        ProjCenter = allocate((size_t)Nc * projDim * sizeof(float));
+        for (int p = 0; p < projDim; p++)
+            for (int k = 0; k < Nv; k++)
+                ROW(Proj, p)[k] = hashUniform(seed, (unsigned long)p * Nv + k) < 0.5f ? -f : f;
+    }
+    #pragma omp parallel for schedule(static)
+    for (int j = 0; j < Nc; j++)
+        for (int p = 0; p < projDim; p++)
+            ProjCenter[j * projDim + p] = dotProduct(ROW(Center, j), ROW(Proj, p));
+}
+
+// *************************************
+// Classifies the samples [start, end) measuring exactly only the
+// shortlist of centers nearest in the projection, and returns
+// their total distance. The samples are projected when first seen.
+float classifyApprox(int start, int end)
+{
+    int i;
+    float totaldist = 0.0f;
+    long moved = 0, miss = 0;
+    #pragma omp parallel
+    {
+        // Reduced precision samples are converted in a buffer of every thread
+        float *buf = precision == PREC_FP32 ? NULL : allocate(stride * sizeof(float));
+        #pragma omp for schedule(static) reduction(+:totaldist, moved, miss)
+        for (i = start; i < end; i++)
+        {
+            int T = shortlist < Nc ? shortlist : Nc, cand[T], minpos = -1;
+            float *x = sample(i, buf), *px = ProjVec + (size_t)i * projDim;
+            float canddist[T], mindist = INFINITY;
+            if (!projected)
+                for (int p = 0; p < projDim; p++)
+                    px[p] = dotProduct(x, ROW(Proj, p));
+            // Shortlist, sorted by the projected distance
+            for (int t = 0; t < T; t++)
+            {
+                cand[t] = -1;
+                canddist[t] = INFINITY;
+            }
+            for (int j = 0; j < Nc; j++)
+            {
+                float dist = 0.0f, *pc = ProjCenter + j * projDim;
+                #pragma omp simd reduction(+:dist)
+                for (int p = 0; p < projDim; p++)
+                    dist += (px[p] - pc[p]) * (px[p] - pc[p]);
+                if (!(dist < canddist[T - 1]))
+                    continue;
+                int t = T - 1;
+                for (; t > 0 && canddist[t - 1] > dist; t--)
+                {
+                    canddist[t] = canddist[t - 1];
+                    cand[t] = cand[t - 1];
+                }
+                canddist[t] = dist;
+                cand[t] = j;
+            }
+            // Exact distances of the shortlist
+            for (int t = 0; t < T && cand[t] >= 0; t++)
             {
+                float dist = euclDist(x, ROW(Center, cand[t]));
+                if (dist < mindist)
+                {
+                    mindist = dist;
+                    minpos = cand[t];
+                }
+            }
+            miss += minpos != cand[0];
+            moved += minpos != Classes[i];
+            Classes[i] = minpos;
+            totaldist += mindist;
+        }
+        free(buf);
+    }
+    reassigned += moved;
+    approxMiss += miss;
+    return totaldist;
+}
+
+// *************************************
+// Returns the nearest center of x and
+// stores its distance in mindist
+int nearestCenter(float *x, float *mindist)
+{
+    float min = euclDist(x, Center);
+    int minpos = 0;
+    for (int j = 1; j < Nc; j++)
+    {
+        float dist = euclDist(x, ROW(Center, j));
+        if (dist < min)
+        {
+            min = dist;
+            minpos = j;
+        }
+    }
+    *mindist = min;
+    return minpos;
+}
+
+// *************************************
+// Prepares Hamerly's bounds for the step.
+// A sample keeps its center without a full search when its distance
+// from it is below both the lower bound of the second nearest center
+// and half the distance of its center from every other one.
+void hamerlyBounds(void)
+{
+    int i;
+    if (Lower == NULL)
+    {
+        Lower = malloc(N * sizeof(float));
+        if (Lower == NULL)
+        {
+            perror("Unable to allocate the bounds");
+            exit(1);
+        }
+    }
+    prune = bounded;
+    maxDrift = 0.0f;
+    if (!prune)
+        return;
+    // The lower bounds shrink by the largest center movement
+    for (i = 0; i < Nc; i++)
+    {
+        float drift = sqrtf(euclDist(ROW(Center, i), ROW(OldCenter, i)));
+        if (isnan(drift))
+            prune = 0; // Empty cluster, fall back to the full search
+        else if (drift > maxDrift)
+            maxDrift = drift;
+    }
+    maxDrift *= 1 + BOUND_EPS;
+    #pragma omp parallel for
+    for (i = 0; i < Nc; i++)
+    {
+        float mindist = INFINITY;
+        for (int j = 0; j < Nc; j++)
+        {
+            float dist = euclDist(ROW(Center, i), ROW(Center, j));
+            if (j != i && dist < mindist)
                 mindist = dist;
-                minpos = j;
+        }
+        Half[i] = 0.5f * sqrtf(mindist) * (1 - BOUND_EPS);
+    }
+}
+
+// *************************************
+// Same as classifyNaive(), but using Hamerly's bounds.
+// The distance from the assigned center is always recomputed,
+// so Classes and the total distance match the full search.
+float classifyHamerly(int start, int end)
+{
+    int i;
+    float totaldist = 0.0f;
+    long skip = 0, moved = 0;
+    #pragma omp parallel
+    {
+        // Reduced precision samples are converted in a buffer of every thread
+        float *buf = precision == PREC_FP32 ? NULL : allocate(stride * sizeof(float));
+        #pragma omp for schedule(static) reduction(+:totaldist, skip, moved)
+        for (i = start; i < end; i++)
+        {
+            float *x = sample(i, buf);
+            if (prune)
+            {
+                int a = Classes[i];
+                float mindist = euclDist(x, ROW(Center, a));
+                float upper = sqrtf(mindist) * (1 + BOUND_EPS);
+                Lower[i] -= maxDrift;
+                if (upper < Half[a] || upper < Lower[i])
+                {
+                    totaldist += mindist;
+                    skip += Nc - 1;
+                    continue;
+                }
+            }
+            // Full search, also keeping the second nearest distance
+            float mindist = euclDist(x, Center), second = INFINITY;
+            int minpos = 0;
+            for (int j = 1; j < Nc; j++)
+            {
+                float dist = euclDist(x, ROW(Center, j));
+                if (dist < mindist)
+                {
+                    second = mindist;
+                    mindist = dist;
+                    minpos = j;
+                }
+                else if (dist < second)
+                    second = dist;
+            }
+            Lower[i] = sqrtf(second) * (1 - BOUND_EPS);
+            totaldist += mindist;
+            moved += minpos != Classes[i];
+            Classes[i] = minpos;
+        }
+        free(buf);
+    }
+    skipped += skip;
+    reassigned += moved;
+    return totaldist;
+}
+
+// *************************************
+// Same as classifyNaive(), but the distances are computed as
+// ||x||^2 - 2x.c + ||c||^2 from blocks of dot products, so every
+// center tile is reused by a whole block of samples.
+float classifyGemm(int start, int end)
+{
+    float totaldist = 0.0f;
+    long moved = 0;
+    #pragma omp parallel
+    {
+        // Reduced precision blocks are converted in a buffer of every thread,
+        // and the dot products of a block go to a tile of every thread
+        float *block = precision == PREC_FP32 ? NULL : allocate(SB * stride * sizeof(float));
+        float *dot = allocate((size_t)SB * Nc * sizeof(float));
+        #pragma omp for schedule(static) reduction(+:totaldist, moved)
+        for (int b = start; b < end; b += SB)
+        {
+            int ns = end - b < SB ? end - b : SB;
+            float *xs = block;
+            if (xs == NULL)
+                xs = ROW(Vec, b);
+            else
+                for (int r = 0; r < ns; r++)
+                    sample(b + r, ROW(xs, r));
+            memset(dot, 0, (size_t)ns * Nc * sizeof(float));
+            for (int k0 = 0; k0 < Nv; k0 += KB)
+            {
+                int k1 = k0 + KB < Nv ? k0 + KB : Nv;
+                for (int c0 = 0; c0 < Nc; c0 += CB)
+                {
+                    int c1 = c0 + CB < Nc ? c0 + CB : Nc;
+                    for (int r = 0; r < ns; r += MR)
+                        for (int j = c0; j < c1; j += NR)
+                        {
+                            if (r + MR <= ns && j + NR <= c1)
+                            {
+                                microKernel(ROW(xs, r), ROW(Center, j), k0, k1, &dot[(size_t)r * Nc + j]);
+                                continue;
+                            }
+                            // Edge of the block, one pair at a time
+                            for (int rr = r; rr < r + MR && rr < ns; rr++)
+                                for (int jj = j; jj < j + NR && jj < c1; jj++)
+                                {
+                                    float sum = 0.0f;
+                                    #pragma omp simd reduction(+:sum)
+                                    for (int k = k0; k < k1; k++)
+                                        sum += ROW(xs, rr)[k] * ROW(Center, jj)[k];
+                                    dot[(size_t)rr * Nc + jj] += sum;
+                                }
+                        }
+                }
+            }
+            // Nearest center of every sample in the block
+            for (int r = 0; r < ns; r++)
+            {
+                float mindist = CenterNorm[0] - 2 * dot[(size_t)r * Nc];
+                int minpos = 0;
+                for (int j = 1; j < Nc; j++)
+                {
+                    float dist = CenterNorm[j] - 2 * dot[(size_t)r * Nc + j];
+                    if (dist < mindist)
+                    {
+                        mindist = dist;
+                        minpos = j;
+                    }
+                }
+                mindist += dotProduct(ROW(xs, r), ROW(xs, r));
+                totaldist += mindist > 0.0f ? mindist : 0.0f;
+                moved += minpos != Classes[b + r];
+                Classes[b + r] = minpos;
             }
         }
-        totaldist += mindist;
-        Classes[i] = minpos;
+        free(block);
+        free(dot);
     }
+    reassigned += moved;
     return totaldist;
 }
 
 // *************************************
-// Calculates the new centers for the next step
+// Adds the dot products of the MR samples starting at x with
+// the NR centers starting at c, over the dimensions [k0, k1),
+// to the MR x NR block of dot (with rows of Nc).
+#if defined(__AVX512F__)
+void microKernel(float *x, float *c, int k0, int k1, float *dot)
+{
+    __m512 acc[MR][NR], cv[NR], xv;
+    int k;
+    for (int r = 0; r < MR; r++)
+        for (int j = 0; j < NR; j++)
+            acc[r][j] = _mm512_setzero_ps();
+    for (k = k0; k + 16 <= k1; k += 16)
+    {
+        for (int j = 0; j < NR; j++)
+            cv[j] = _mm512_loadu_ps(c + j * stride + k);
+        for (int r = 0; r < MR; r++)
+        {
+            xv = _mm512_loadu_ps(x + r * stride + k);
+            for (int j = 0; j < NR; j++)
+                acc[r][j] = _mm512_fmadd_ps(xv, cv[j], acc[r][j]);
+        }
+    }
+    if (k < k1)
+    {
+        __mmask16 m = (__mmask16)((1u << (k1 - k)) - 1);
+        for (int j = 0; j < NR; j++)
+            cv[j] = _mm512_maskz_loadu_ps(m, c + j * stride + k);
+        for (int r = 0; r < MR; r++)
+        {
+            xv = _mm512_maskz_loadu_ps(m, x + r * stride + k);
+            for (int j = 0; j < NR; j++)
+                acc[r][j] = _mm512_fmadd_ps(xv, cv[j], acc[r][j]);
+        }
+    }
+    for (int r = 0; r < MR; r++)
+        for (int j = 0; j < NR; j++)
+            dot[r * Nc + j] += _mm512_reduce_add_ps(acc[r][j]);
+}
+#elif defined(__AVX2__) && defined(__FMA__)
+void microKernel(float *x, float *c, int k0, int k1, float *dot)
+{
+    __m256 acc[MR][NR], cv[NR], xv;
+    float tail[MR][NR] = {{0.0f}}, lanes[8];
+    int k;
+    for (int r = 0; r < MR; r++)
+        for (int j = 0; j < NR; j++)
+            acc[r][j] = _mm256_setzero_ps();
+    for (k = k0; k + 8 <= k1; k += 8)
+    {
+        for (int j = 0; j < NR; j++)
+            cv[j] = _mm256_loadu_ps(c + j * stride + k);
+        for (int r = 0; r < MR; r++)
+        {
+            xv = _mm256_loadu_ps(x + r * stride + k);
+            for (int j = 0; j < NR; j++)
+                acc[r][j] = _mm256_fmadd_ps(xv, cv[j], acc[r][j]);
+        }
+    }
+    for (; k < k1; k++)
+        for (int r = 0; r < MR; r++)
+            for (int j = 0; j < NR; j++)
+                tail[r][j] += x[r * stride + k] * c[j * stride + k];
+    for (int r = 0; r < MR; r++)
+        for (int j = 0; j < NR; j++)
+        {
+            _mm256_storeu_ps(lanes, acc[r][j]);
+            dot[r * Nc + j] += tail[r][j] + lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+                               lanes[4] + lanes[5] + lanes[6] + lanes[7];
+        }
+}
+#else
+void microKernel(float *x, float *c, int k0, int k1, float *dot)
+{
+    for (int r = 0; r < MR; r++)
+        for (int j = 0; j < NR; j++)
+        {
+            float sum = 0.0f;
+            #pragma omp simd reduction(+:sum)
+            for (int k = k0; k < k1; k++)
+                sum += x[r * stride + k] * c[j * stride + k];
+            dot[r * Nc + j] += sum;
+        }
+}
+#endif
+
+// *************************************
+// Classifies the samples of a dataset stream with the centers
+// of a model file and writes their classes as int32.
+// The reader thread fills one batch while the other is classified
+// by the assignment kernels, so reading overlaps the distances.
+void predict(char *modelPath, char *inPath, char *outPath)
+{
+    char pad[DATASET_OFFSET];
+    const char *error;
+    DATASET head;
+    BATCH batch[2];
+    pthread_t reader;
+    long left, total = 0;
+    int cur = 0, partial = 0;
+    double start;
+    loadModel(modelPath);
+    FILE *in = strcmp(inPath, "-") ? fopen(inPath, "rb") : stdin;
+    FILE *out = strcmp(outPath, "-") ? fopen(outPath, "wb") : stdout;
+    if (in == NULL || out == NULL)
+    {
+        perror("Unable to open the predict files");
+        exit(1);
+    }
+    if (fread(pad, 1, DATASET_OFFSET, in) != DATASET_OFFSET)
+    {
+        fprintf(stderr, "%s: not a dataset file\n", inPath);
+        exit(1);
+    }
+    memcpy(&head, pad, sizeof(head));
+    if ((error = checkDataset(&head, DATASET_FLOAT)) != NULL)
+    {
+        fprintf(stderr, "%s: %s\n", inPath, error);
+        exit(1);
+    }
+    if (head.dims != (uint32_t)Nv || head.stride != (uint32_t)stride)
+    {
+        fprintf(stderr, "%s: %u dimensions, the model has %d\n", inPath, head.dims, Nv);
+        exit(1);
+    }
+    left = head.rows > 0 && head.rows < LONG_MAX ? (long)head.rows : LONG_MAX;
+    for (int b = 0; b < 2; b++)
+    {
+        batch[b].fp = in;
+        batch[b].left = &left;
+        batch[b].partial = &partial;
+        batch[b].rows = allocate((size_t)PREDICT_BATCH * stride * sizeof(float));
+    }
+    Classes = allocate(PREDICT_BATCH * sizeof(int));
+    if (assignMode == ASSIGN_GEMM)
+        for (int j = 0; j < Nc; j++)
+            CenterNorm[j] = dotProduct(ROW(Center, j), ROW(Center, j));
+    start = omp_get_wtime();
+    readBatch(&batch[0]);
+    while (batch[cur].count > 0)
+    {
+        if (pthread_create(&reader, NULL, readBatch, &batch[1 - cur]))
+        {
+            fprintf(stderr, "Unable to start the reader thread\n");
+            exit(1);
+        }
+        Vec = batch[cur].rows;
+        if (assignMode == ASSIGN_GEMM)
+            classifyGemm(0, batch[cur].count);
+        else
+            classifyNaive(0, batch[cur].count);
+        pthread_join(reader, NULL);
+        if (fwrite(Classes, sizeof(int), batch[cur].count, out) != (size_t)batch[cur].count)
+        {
+            perror("Unable to write the classes");
+            exit(1);
+        }
+        total += batch[cur].count;
+        cur = 1 - cur;
+    }
+    if (ferror(in))
+    {
+        perror("Unable to read the samples");
+        exit(1);
+    }
+    // Only a header of 0 samples reads until end of file
+    if (partial || (head.rows > 0 && left > 0))
+    {
+        fprintf(stderr, "%s: truncated dataset stream, %ld whole samples\n", inPath, total);
+        exit(1);
+    }
+    if (fflush(out) || (out != stdout && fclose(out)))
+    {
+        perror("Unable to write the classes");
+        exit(1);
+    }
+    double elapsed = omp_get_wtime() - start;
+    fprintf(stderr, "Predicted %ld samples in %.3f s: %.0f samples/s, %.1f MB/s\n",
+            total, elapsed, total / elapsed, total * (double)Nv * sizeof(float) / elapsed / 1e6);
+}
+
+// *************************************
+// Reads the next batch of samples of the predict input
+void *readBatch(void *arg)
+{
+    BATCH *b = arg;
+    long want = *b->left < PREDICT_BATCH ? *b->left : PREDICT_BATCH;
+    size_t row = stride * sizeof(float), bytes = fread(b->rows, 1, want * row, b->fp);
+    b->count = bytes / row;
+    if (bytes % row)
+        *b->partial = 1;
+    *b->left -= b->count;
+    return NULL;
+}
+
+// *************************************
+// Prints the available options
+void usage(char *name)
+{
+    fprintf(stderr, "Usage: %s [-n samples] [-d dimensions] [-k centers] [-seed value]\n"
+                    "          [-assign naive|hamerly|gemm|pds [-reorder]]\n"
+                    "          [-assign approx [-projdim count] [-shortlist count]]\n"
+                    "          [-data file [-chunk samples]] [-write file]\n"
+                    "          [-batch size [-movetol distance]] [-init random|parallel]\n"
+                    "          [-steps count] [-tol fraction] [-moved count] [-incremental]\n"
+                    "          [-precision fp32|fp16|int8 [-check]] [-restarts count] [-save model]\n"
+                    "       %s -predict model [-input file] [-output file] [-assign naive|gemm]\n", name, name);
+    exit(1);
+}
+
+// *************************************
+// Calculates the new centers for the next step.
+// The samples are summed into SUM_PARTS partial copies of the
+// centers, every one over its own blocks in order, then every
+// center adds its partial copies in order. The threads share out
+// the partial sums and then the centers, so both phases scale with
+// the threads and the centers do not depend on their number.
+// With restarts, every sample is added to a center of every set.
 void estimateCenters(void)
 {
-    int i, counters[Nc];
-    memset(Center, 0, sizeof(Center));
-    memset(counters, 0, sizeof(counters));
-    for (int i = 0; i < N; i++)
+    static float *partial = NULL; // Partial sums
+    static int *partialCount;     // Partial counters
+    static int parts;
+    int centers = restarts * Nc;
+    size_t size = (size_t)centers * stride;
+    if (partial == NULL)
     {
-        int j = Classes[i];
-        counters[j]++;
-        #pragma omp simd
-        for (int k = 0; k < Nv; k++)
+        parts = (N + SUM_BLOCK - 1) / SUM_BLOCK < SUM_PARTS ? (N + SUM_BLOCK - 1) / SUM_BLOCK : SUM_PARTS;
+        partial = aligned_alloc(ALIGN, parts * size * sizeof(float));
+        partialCount = malloc(parts * centers * sizeof(int));
+        if (partial == NULL || partialCount == NULL)
         {
-            Center[j][k] += Vec[i][k];
+            perror("Unable to allocate the center sums");
+            exit(1);
         }
     }
-    for (i = 0; i < Nc; i++)
+    #pragma omp parallel
     {
-        float f = 1.0 / counters[i];
-        #pragma omp simd
-        for (int j = 0; j < Nv; j++)
-            Center[i][j] *= f;
+        float *buf = precision == PREC_FP32 ? NULL : allocate(stride * sizeof(float));
+        // Cleared with the schedule of the sums, so the pages are local
+        #pragma omp for schedule(static)
+        for (int p = 0; p < parts; p++)
+        {
+            memset(partial + p * size, 0, size * sizeof(float));
+            memset(partialCount + p * centers, 0, centers * sizeof(int));
+        }
+        for (int start = 0; start < N; start += chunk)
+        {
+            int end = start + chunk < N ? start + chunk : N;
+            #pragma omp single nowait
+            prefetchChunk(end);
+            #pragma omp for schedule(static)
+            for (int p = 0; p < parts; p++)
+            {
+                float *sum = partial + p * size;
+                int *counters = partialCount + p * centers;
+                // First block of the part in the chunk
+                long b = start / SUM_BLOCK;
+                b += (p - b % parts + parts) % parts;
+                for (; b * SUM_BLOCK < end; b += parts)
+                {
+                    int first = b * SUM_BLOCK > start ? b * SUM_BLOCK : start;
+                    int last = (b + 1) * SUM_BLOCK < end ? (b + 1) * SUM_BLOCK : end;
+                    for (int i = first; i < last; i++)
+                    {
+                        float *x = sample(i, buf);
+                        for (int r = 0; r < restarts; r++)
+                        {
+                            int j = r * Nc + Classes[(size_t)r * N + i];
+                            float *s = ROW(sum, j);
+                            counters[j]++;
+                            #pragma omp simd
+                            for (int k = 0; k < Nv; k++)
+                                s[k] += x[k];
+                        }
+                    }
+                }
+            }
+            #pragma omp single nowait
+            releaseChunk(start);
+        }
+        free(buf);
+        #pragma omp for schedule(static)
+        for (int i = 0; i < centers; i++)
+        {
+            int count = 0;
+            float *c = ROW(Center, i);
+            memset(c, 0, Nv * sizeof(float));
+            for (int p = 0; p < parts; p++)
+            {
+                float *s = ROW(partial + p * size, i);
+                count += partialCount[p * centers + i];
+                #pragma omp simd
+                for (int k = 0; k < Nv; k++)
+                    c[k] += s[k];
+            }
+            float f = 1.0 / count;
+            #pragma omp simd
+            for (int k = 0; k < Nv; k++)
+                c[k] *= f;
+        }
     }
 }
 
+// *************************************
+// Classifies each sample on the nearest center of every
+// restart with a full search, in a single pass over the
+// samples, and stores the total distance of every restart
+void classifyRestarts(float *totaldist)
+{
+    int R = restarts;
+    for (int r = 0; r < R; r++)
+        totaldist[r] = 0.0f;
+    for (int start = 0; start < N; start += chunk)
+    {
+        int end = start + chunk < N ? start + chunk : N;
+        prefetchChunk(end);
+        #pragma omp parallel
+        {
+            // Reduced precision samples are converted in a buffer of every thread
+            float *buf = precision == PREC_FP32 ? NULL : allocate(stride * sizeof(float));
+            #pragma omp for schedule(static) reduction(+:totaldist[:R])
+            for (int i = start; i < end; i++)
+            {
+                float *x = sample(i, buf);
+                for (int r = 0; r < R; r++)
+                {
+                    float *c = ROW(Center, r * Nc), min = euclDist(x, c);
+                    int minpos = 0;
+                    for (int j = 1; j < Nc; j++)
+                    {
+                        float dist = euclDist(x, ROW(c, j));
+                        if (dist < min)
+                        {
+                            min = dist;
+                            minpos = j;
+                        }
+                    }
+                    Classes[(size_t)r * N + i] = minpos;
+                    totaldist[r] += min;
+                }
+            }
+            free(buf);
+        }
+        releaseChunk(start);
+    }
+}
+
+// *************************************
+// Runs the K-means steps of all the restarts together, then
+// keeps the restart with the lowest total distance as the
+// only one and returns its total distance
+float multiRestart(int steps)
+{
+    float dist[restarts], prevdist[restarts];
+    int best = 0;
+    classifyRestarts(dist);
+    for (int c = 0; c < steps; c++)
+    {
+        estimateCenters();
+        memcpy(prevdist, dist, sizeof(dist));
+        classifyRestarts(dist);
+        for (int r = 0; r < restarts; r++)
+            printf("%f%c", prevdist[r] - dist[r], r + 1 < restarts ? ' ' : '\n');
+    }
+    for (int r = 1; r < restarts; r++)
+        if (dist[r] < dist[best])
+            best = r;
+    printf("Best restart: %d of %d, total distance %f\n", best + 1, restarts, dist[best]);
+    memmove(Center, ROW(Center, best * Nc), Nc * stride * sizeof(float));
+    memmove(Classes, Classes + (size_t)best * N, N * sizeof(int));
+    restarts = 1;
+    return dist[best];
+}
+
+// *************************************
+// Calculates the new centers for the next step incrementally.
+// The sums and counters of every cluster are kept across the steps,
+// with Built holding the class each sample is counted in. Only the
+// samples that changed class since are removed from their old sums
+// and added to the new ones, in parallel over the clusters.
+void updateCenters(void)
+{
+    static double *Sum = NULL; // Sum of the samples of every cluster
+    static long *Count;        // Samples of every cluster
+    static int *Built;         // Class every sample is counted in
+    static int *Moved;         // Samples that changed class
+    int i, nmoved = 0;
+    if (Sum == NULL)
+    {
+        Sum = allocate((size_t)Nc * stride * sizeof(double));
+        Count = allocate(Nc * sizeof(long));
+        Built = malloc(N * sizeof(int));
+        Moved = malloc(N * sizeof(int));
+        if (Built == NULL || Moved == NULL)
+        {
+            perror("Unable to allocate the center sums");
+            exit(1);
+        }
+        #pragma omp parallel for schedule(static)
+        for (i = 0; i < N; i++)
+            Built[i] = -1;
+    }
+    for (i = 0; i < N; i++)
+        if (Classes[i] != Built[i])
+            Moved[nmoved++] = i;
+    #pragma omp parallel
+    {
+        // Reduced precision samples are converted in a buffer of every thread
+        float *buf = precision == PREC_FP32 ? NULL : allocate(stride * sizeof(float));
+        #pragma omp for schedule(dynamic)
+        for (int j = 0; j < Nc; j++)
+        {
+            double *s = ROW(Sum, j);
+            int changed = 0;
+            for (int p = 0; p < nmoved; p++)
+            {
+                int m = Moved[p];
+                float *x;
+                if (Built[m] == j)
+                {
+                    x = sample(m, buf);
+                    Count[j]--;
+                    #pragma omp simd
+                    for (int k = 0; k < Nv; k++)
+                        s[k] -= x[k];
+                }
+                else if (Classes[m] == j)
+                {
+                    x = sample(m, buf);
+                    Count[j]++;
+                    #pragma omp simd
+                    for (int k = 0; k < Nv; k++)
+                        s[k] += x[k];
+                }
+                else
+                    continue;
+                changed = 1;
+            }
+            if (!changed)
+                continue;
+            float *c = ROW(Center, j);
+            double f = 1.0 / Count[j];
+            #pragma omp simd
+            for (int k = 0; k < Nv; k++)
+                c[k] = s[k] * f;
+        }
+        free(buf);
+    }
+    #pragma omp parallel for
+    for (int p = 0; p < nmoved; p++)
+        Built[Moved[p]] = Classes[Moved[p]];
+}
+
+// *************************************
+// Mini-batch K-means. Every step assigns a random batch in parallel,
+// then every center absorbs its samples of the batch in order, with a
+// learning rate of 1 / (samples absorbed so far). The centers are
+// updated in parallel, as every one of them has its own samples.
+// Returns the number of steps until no center moved more than tol.
+int miniBatch(int batch, float tol)
+{
+    int step, *samples, *sampleClass, *order;
+    int first[Nc + 1];
+    long absorbed[Nc];
+    memset(absorbed, 0, sizeof(absorbed));
+    samples = malloc(batch * sizeof(int));
+    sampleClass = malloc(batch * sizeof(int));
+    order = malloc(batch * sizeof(int));
+    if (samples == NULL || sampleClass == NULL || order == NULL)
+    {
+        perror("Unable to allocate the batch");
+        exit(1);
+    }
+    for (step = 1; step <= MB_STEPS; step++)
+    {
+        int b;
+        float move = 0.0f;
+        for (b = 0; b < batch; b++)
+            samples[b] = rand() % N;
+        #pragma omp parallel
+        {
+            // Reduced precision samples are converted in a buffer of every thread
+            float *buf = precision == PREC_FP32 ? NULL : allocate(stride * sizeof(float));
+            #pragma omp for
+            for (b = 0; b < batch; b++)
+            {
+                float mindist;
+                sampleClass[b] = nearestCenter(sample(samples[b], buf), &mindist);
+            }
+            free(buf);
+        }
+        // Group the batch by center, keeping the batch order
+        memset(first, 0, sizeof(first));
+        for (b = 0; b < batch; b++)
+            first[sampleClass[b] + 1]++;
+        for (int j = 0; j < Nc; j++)
+            first[j + 1] += first[j];
+        for (b = 0; b < batch; b++)
+            order[first[sampleClass[b]]++] = b;
+        for (int j = Nc; j > 0; j--)
+            first[j] = first[j - 1];
+        first[0] = 0;
+        #pragma omp parallel
+        {
+            // The previous center and the converted samples, in buffers of every thread
+            float *old = allocate(Nv * sizeof(float));
+            float *buf = precision == PREC_FP32 ? NULL : allocate(stride * sizeof(float));
+            #pragma omp for schedule(dynamic) reduction(max:move)
+            for (int j = 0; j < Nc; j++)
+            {
+                float *c = ROW(Center, j);
+                if (first[j] == first[j + 1])
+                    continue;
+                memcpy(old, c, Nv * sizeof(float));
+                for (int p = first[j]; p < first[j + 1]; p++)
+                {
+                    float *x = sample(samples[order[p]], buf);
+                    float eta = 1.0f / ++absorbed[j];
+                    #pragma omp simd
+                    for (int k = 0; k < Nv; k++)
+                        c[k] += eta * (x[k] - c[k]);
+                }
+                float dist = euclDist(old, c);
+                if (dist > move)
+                    move = dist;
+            }
+            free(old);
+            free(buf);
+        }
+        if (sqrtf(move) < tol)
+            break;
+    }
+    free(samples);
+    free(sampleClass);
+    free(order);
+    return step > MB_STEPS ? MB_STEPS : step;
+}
+
 // *************************************
 // Calculates the square of the euclidean distance
 // between two vectors.
@@ -136,24 +1750,223 @@ float euclDist(float *a, float *b)
 }
 
 // *************************************
-int main(void)
+// Calculates the dot product of two vectors.
+float dotProduct(float *a, float *b)
 {
-    int c = 0;
-    float dist, prevdist, dif;
+    int i;
+    float dot = 0.0;
+    #pragma omp simd reduction(+:dot)
+    for (i = 0; i < Nv; i++)
+        dot += a[i] * b[i];
+    return dot;
+}
+
+// *************************************
+int main(int argc, char *argv[])
+{
+    int c = 0, batch = 0, parallelInit = 0, steps = STEPS, incremental = 0, check = 0;
+    long maxMoved = -1;
+    float dist, prevdist, dif, moveTol = MOVE_TOL, distTol = 0.0f;
+    char *dataPath = NULL, *writePath = NULL, *savePath = NULL;
+    char *predictPath = NULL, *inPath = "-", *outPath = "-";
+    // Parse the options
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-assign") && i + 1 < argc)
+        {
+            i++;
+            if (!strcmp(argv[i], "naive"))
+                assignMode = ASSIGN_NAIVE;
+            else if (!strcmp(argv[i], "hamerly"))
+                assignMode = ASSIGN_HAMERLY;
+            else if (!strcmp(argv[i], "gemm"))
+                assignMode = ASSIGN_GEMM;
+            else if (!strcmp(argv[i], "pds"))
+                assignMode = ASSIGN_PDS;
+            else if (!strcmp(argv[i], "approx"))
+                assignMode = ASSIGN_APPROX;
+            else
+                usage(argv[0]);
+        }
+        else if (!strcmp(argv[i], "-n") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            N = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-d") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            Nv = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-k") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            Nc = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-seed") && i + 1 < argc)
+            dataSeed = strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "-data") && i + 1 < argc)
+            dataPath = argv[++i];
+        else if (!strcmp(argv[i], "-chunk") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            chunk = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-write") && i + 1 < argc)
+            writePath = argv[++i];
+        else if (!strcmp(argv[i], "-batch") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            batch = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-movetol") && i + 1 < argc)
+            moveTol = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-steps") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            steps = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-tol") && i + 1 < argc)
+            distTol = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-moved") && i + 1 < argc)
+            maxMoved = atol(argv[++i]);
+        else if (!strcmp(argv[i], "-incremental"))
+            incremental = 1;
+        else if (!strcmp(argv[i], "-precision") && i + 1 < argc)
+        {
+            i++;
+            if (!strcmp(argv[i], "fp32"))
+                precision = PREC_FP32;
+            else if (!strcmp(argv[i], "fp16"))
+                precision = PREC_FP16;
+            else if (!strcmp(argv[i], "int8"))
+                precision = PREC_INT8;
+            else
+                usage(argv[0]);
+        }
+        else if (!strcmp(argv[i], "-check"))
+            check = 1;
+        else if (!strcmp(argv[i], "-reorder"))
+            reorder = 1;
+        else if (!strcmp(argv[i], "-projdim") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            projDim = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-shortlist") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            shortlist = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-restarts") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            restarts = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-save") && i + 1 < argc)
+            savePath = argv[++i];
+        else if (!strcmp(argv[i], "-predict") && i + 1 < argc)
+            predictPath = argv[++i];
+        else if (!strcmp(argv[i], "-input") && i + 1 < argc)
+            inPath = argv[++i];
+        else if (!strcmp(argv[i], "-output") && i + 1 < argc)
+            outPath = argv[++i];
+        else if (!strcmp(argv[i], "-init") && i + 1 < argc)
+        {
+            i++;
+            if (!strcmp(argv[i], "random"))
+                parallelInit = 0;
+            else if (!strcmp(argv[i], "parallel"))
+                parallelInit = 1;
+            else
+                usage(argv[0]);
+        }
+        else
+            usage(argv[0]);
+    }
+    // Restarts run -steps steps of the full search, naive
+    if (restarts > 1 && (batch > 0 || incremental || assignMode != ASSIGN_NAIVE || check ||
+                         distTol > 0.0f || maxMoved >= 0))
+        usage(argv[0]);
+    // Predicting classifies fp32 samples with a full search, naive or gemm
+    if (predictPath != NULL && (precision != PREC_FP32 || check || restarts > 1 || batch > 0 || incremental ||
+                                (assignMode != ASSIGN_NAIVE && assignMode != ASSIGN_GEMM)))
+        usage(argv[0]);
+    if (predictPath != NULL)
+    {
+        predict(predictPath, inPath, outPath);
+        return 0;
+    }
     // Initialize data
-    createData();
-    createCenters();
+    if (dataPath != NULL)
+    {
+        loadData(dataPath);
+        if (chunk == 0)
+            chunk = CHUNK_BYTES / (stride * sizeof(float)) + 1;
+    }
+    else
+    {
+        if (Nc > N)
+            usage(argv[0]);
+        stride = (Nv * sizeof(float) + ALIGN - 1) / ALIGN * ALIGN / sizeof(float);
+        createData();
+        chunk = N;
+    }
+    if (writePath != NULL)
+    {
+        writeData(writePath);
+        return 0;
+    }
+    Classes = malloc((size_t)restarts * N * sizeof(int));
+    if (Classes == NULL)
+    {
+        perror("Unable to allocate the classes");
+        exit(1);
+    }
+    #pragma omp parallel for schedule(static)
+    for (long i = 0; i < (long)restarts * N; i++)
+        Classes[i] = -1;
+    allocateCenters();
+    // Every restart is seeded on its own
+    float *centers = Center;
+    for (int r = 0; r < restarts; r++)
+    {
+        Center = ROW(centers, r * Nc);
+        if (parallelInit)
+            createCentersParallel();
+        else
+            createCenters();
+    }
+    Center = centers;
+    if (precision != PREC_FP32)
+    {
+        quantizeData();
+        if (!check && !mapped)
+        {
+            free(Vec);
+            Vec = NULL;
+        }
+    }
+    check = check && (precision != PREC_FP32 || assignMode == ASSIGN_APPROX);
+    if (batch > 0)
+    {
+        c = miniBatch(batch, moveTol);
+        printf("Mini-batch steps: %d\n", c);
+        printf("Total distance: %f\n", classification());
+        if (savePath != NULL)
+            saveModel(savePath);
+        return 0;
+    }
+    if (restarts > 1)
+    {
+        multiRestart(steps);
+        if (savePath != NULL)
+            saveModel(savePath);
+        return 0;
+    }
     // First classification
     dist = classification();
-    // 15 more K-means steps
+    // The K-means steps
     do
     {
-        estimateCenters();
+        if (incremental)
+            updateCenters();
+        else
+            estimateCenters();
         prevdist = dist;
         dist = classification();
         dif = prevdist - dist;
         c++;
         printf("%f\n", dif);
-    } while (c < 16);
+        if (assignMode == ASSIGN_HAMERLY)
+            printf("Skipped distances: %ld of %ld\n", skipped, (long)N * Nc);
+        if (assignMode == ASSIGN_PDS)
+            printf("Dimensions per distance: %.1f of %d\n", (double)touched / computed, Nv);
+        if (assignMode == ASSIGN_APPROX)
+            printf("Projected winner not the nearest: %ld of %d\n", approxMiss, N);
+        if (check)
+            printf("Differences from %s: %ld of %d\n",
+                   precision != PREC_FP32 ? "fp32" : "the full search", checkPrecision(), N);
+        if (reassigned <= maxMoved || (distTol > 0.0f && dif <= distTol * prevdist))
+        {
+            printf("Converged after %d steps (%ld samples moved)\n", c, reassigned);
+            break;
+        }
+    } while (c < steps);
+    if (savePath != NULL)
+        saveModel(savePath);
     return 0;
 }
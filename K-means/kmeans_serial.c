@@ -1,6 +1,9 @@
 /* 
 Compiling: gcc kmeans_serial.c -o kmeans_serial -O2
-Executing: time ./kmeans_serial
+Executing: time ./kmeans_serial [dataset file]
+The data comes from the generator of common/dataset.h, or from a dataset
+file of 100000 samples of 1000 dimensions (kmeans_parallel -write, or
+mkdataset) when one is given
 Time of execution:
 
 real    3m40,092s
@@ -11,6 +14,7 @@ sys     0m0,269s
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "../common/dataset.h"
 
 // *************************************
 #define N 100000 // Number of samples
@@ -19,6 +23,7 @@ sys     0m0,269s
 
 // *************************************
 void createData(void);
+void loadData(char *path);
 void createCenters(void);
 float classification(void);
 void estimateCenters(void);
@@ -34,10 +39,27 @@ int Classes[N];       // Classification array
 // The range is (-2, 2) for every dimension
 void createData(void)
 {
-    int i, j;
+    int i;
     for (i = 0; i < N; i++)
-        for (j = 0; j < Nv; j++)
-            Vec[i][j] = 4 * (rand() / (float)RAND_MAX - 0.5);
+        randomSamples(DATASET_SEED, (size_t)i * Nv, Nv, Vec[i]);
+}
+
+// *************************************
+// Reads the data from a dataset file
+void loadData(char *path)
+{
+    int i;
+    size_t size;
+    DATASET *head = mapDataset(path, DATASET_FLOAT, &size);
+    float *rows = DATASET_ROWS(head);
+    if (head->rows != N || head->dims != Nv)
+    {
+        fprintf(stderr, "%s: not %d samples of %d dimensions\n", path, N, Nv);
+        exit(1);
+    }
+    for (i = 0; i < N; i++)
+        memcpy(Vec[i], rows + (size_t)i * head->stride, sizeof(float) * Nv);
+    munmap(head, size);
 }
 
 // *************************************
@@ -131,12 +153,15 @@ float euclDist(float *a, float *b)
 }
 
 // *************************************
-int main(void)
+int main(int argc, char *argv[])
 {
     int c = 0;
     float dist, prevdist, dif;
     // Initialize data
-    createData();
+    if (argc > 1)
+        loadData(argv[1]);
+    else
+        createData();
     createCenters();
     // First classification
     dist = classification();
@@ -0,0 +1,133 @@
+/*
+Classifies Fashion-MNIST images with a trained NN, the checkpoint
+file written by fashion-NN -checkpoint, without training it again.
+The checkpoint is memory mapped and its weights are used in place.
+The images come from a binary file of bytes (see common/dataset.h),
+the .bin copy fashion-NN makes of a csv file, also mapped. The
+threads share out batches of images, run through the layers as
+matrix-matrix products, and the program prints the accuracy, the
+images per second and the median (p50) and p99 time of a batch.
+
+Compiling: gcc fashion-NN-infer.c -o fashion-NN-infer -O3 -march=native -fopenmp -lm
+           (-DNN_FLOAT for the checkpoints of a -DNN_FLOAT fashion-NN)
+Executing: ./fashion-NN-infer checkpoint [-data file] [-batch size] [-output file]
+Options:
+    -data file      binary file of images (default fashion-mnist_test.bin)
+    -batch size     images per batch (default 64)
+    -output file    writes the class of every image, as int32
+
+Output, for 784-100-10 checkpoints after 3 epochs (double sample by
+sample, float -batch 32) and 10000 synthetic images, 1-core linux VM:
+
+double  Classified 10000 images in 0.040 s: 251262 images/s, accuracy 87.39 %
+        Batches of 64 images: p50 0.25 ms, p99 0.31 ms
+float   Classified 10000 images in 0.027 s: 369731 images/s, accuracy 87.49 %
+        Batches of 64 images: p50 0.17 ms, p99 0.22 ms
+*/
+
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../common/dataset.h"
+#include "nn.h"
+
+#define DATA "fashion-mnist_test.bin"	// Default images
+#define BATCH 64				// Default images per batch
+
+// Compares two batch times, for qsort
+int compareTimes(const void *a, const void *b){
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+// Prints the available options
+void usage(char *name){
+	fprintf(stderr, "Usage: %s checkpoint [-data file] [-batch size] [-output file]\n", name);
+	exit(1);
+}
+
+int main(int argc, char *argv[]) {
+	char *dataPath = DATA, *outPath = NULL;
+	int batch = BATCH;
+	size_t checkpointSize, dataSize;
+	// Parse the options
+	if(argc < 2 || argv[1][0] == '-')
+		usage(argv[0]);
+	for(int i = 2; i < argc; i++){
+		if(!strcmp(argv[i], "-data") && i + 1 < argc)
+			dataPath = argv[++i];
+		else if(!strcmp(argv[i], "-batch") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+			batch = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-output") && i + 1 < argc)
+			outPath = argv[++i];
+		else
+			usage(argv[0]);
+	}
+
+	mapCheckpoint(argv[1], &checkpointSize);
+	DATASET *head = mapDataset(dataPath, DATASET_BYTE, &dataSize);
+	if (head->rows == 0 || head->dims != Ninp + 1 || head->stride != Ninp + 1) {
+		fprintf(stderr, "%s: not a file of samples of %d pixels\n", dataPath, Ninp);
+		exit(1);
+	}
+	SAMPLE *images = DATASET_ROWS(head);
+	long count = head->rows, batches = (count + batch - 1) / batch;
+	initPixels();
+	printf("Layers %d", Ninp);
+	for(int l = 0; l < layers; l++)
+		printf("-%d", Layer[l].out);
+	printf(", %ld images of %s\n", count, dataPath);
+
+	// The activations of every thread, for a batch
+	int threads = omp_get_max_threads();
+	WORK work[threads];
+	real *arena = aligned_alloc(64, threads * workSize(batch) * sizeof(real));
+	int *classes = malloc(count * sizeof(int));
+	double *times = malloc(batches * sizeof(double));
+	if (arena == NULL || classes == NULL || times == NULL) {
+		perror("Unable to allocate the batches");
+		exit(1);
+	}
+	real *next = arena;
+	for(int t = 0; t < threads; t++)
+		carveWork(&work[t], batch, &next);
+
+	long correct = 0;
+	double start = omp_get_wtime();
+	#pragma omp parallel reduction(+:correct)
+	{
+		WORK *w = &work[omp_get_thread_num()];
+		#pragma omp for schedule(dynamic)
+		for(long b = 0; b < batches; b++){
+			double begin = omp_get_wtime();
+			long first = b * batch;
+			int rows = count - first < batch ? count - first : batch;
+			for(int m = 0; m < rows; m++)
+				inputRow(images[first + m], w->O[0] + (size_t)m * LD(0));
+			forwardRows(w, rows);
+			for(int m = 0; m < rows; m++){
+				classes[first + m] = classify(w->O[layers] + (size_t)m * LD(layers));
+				if(classes[first + m] == images[first + m][0])
+					correct++;
+			}
+			times[b] = omp_get_wtime() - begin;
+		}
+	}
+	double time = omp_get_wtime() - start;
+
+	qsort(times, batches, sizeof(double), compareTimes);
+	printf("Classified %ld images in %.3f s: %.0f images/s, accuracy %g %%\n",
+	       count, time, count / time, 100. * correct / count);
+	printf("Batches of %d images: p50 %.2f ms, p99 %.2f ms\n",
+	       batch, 1000 * times[(batches - 1) / 2], 1000 * times[(batches - 1) * 99 / 100]);
+
+	if (outPath != NULL) {
+		FILE *fp = fopen(outPath, "wb");
+		if (fp == NULL || fwrite(classes, sizeof(int), count, fp) != (size_t)count || fclose(fp)) {
+			perror("Unable to write the classes");
+			exit(1);
+		}
+	}
+	return 0;
+}
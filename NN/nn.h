@@ -0,0 +1,319 @@
+/*
+The NN of fashion-NN.c, shared with fashion-NN-infer.c: the precision,
+the layers and their forward kernels, and the checkpoint files.
+
+Checkpoints hold the layer widths and the weights, which start at
+CHECKPOINT_OFFSET and are stored as in memory, rows of in + 1 weights
+padded to 64 bytes, so a mapped checkpoint runs as it is. fashion-NN
+also stores the progress of its training in them, to resume it.
+*/
+
+#ifndef NN_H
+#define NN_H
+
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// NN parameters
+#define Ninp 784			// Input dimension
+#define NL2 10				// Number of output neurons
+#define MAX_LAYERS 8		// Most layers, with the output layer
+#define MAX_WIDTH 65536		// Most neurons of a hidden layer
+
+// Precision of the NN, double unless built with -DNN_FLOAT.
+// The sigmoid builds 2^k from the bits of an integer of the same size.
+#ifdef NN_FLOAT
+typedef float real;
+typedef int32_t realBits;
+#define EXP expf
+#define ROUNDER 12582912.0f	// 1.5 * 2^23, adding it rounds to an integer
+#define MANTISSA 23			// Mantissa bits
+#define EXP_BIAS 127		// Exponent bias
+#define EXP_LIMIT 87		// Largest |x| of the sigmoid exponential
+#define SIG_DEGREE 6		// Degree of the exponential polynomial
+#else
+typedef double real;
+typedef int64_t realBits;
+#define EXP exp
+#define ROUNDER 6755399441055744.0	// 1.5 * 2^52
+#define MANTISSA 52
+#define EXP_BIAS 1023
+#define EXP_LIMIT 708
+#define SIG_DEGREE 12
+#endif
+
+// Rows of the layers
+#define LANES (64 / (int)sizeof(real))	// Values per 64 bytes
+#define PAD(n) (((n) + LANES - 1) / LANES * LANES)	// Batch rows padded to 64 bytes
+
+// Inputs of a layer, with the bias, that get the dot product and
+// gemmNT kernels compiled for their size: the input layer and
+// hidden layers of 100 and of 32 to 512 neurons
+#define SPECIAL_WIDTHS(f) f(Ninp + 1) f(101) f(33) f(65) f(129) f(257) f(513)
+
+// Checkpoint files: a CHECKPOINT header, then the weights
+#define CHECKPOINT_MAGIC "NNCHECKP"
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_OFFSET 128	// Offset of the weights in the file
+
+typedef struct checkpoint{
+	char magic[8];			// CHECKPOINT_MAGIC
+	uint32_t version;		// CHECKPOINT_VERSION
+	uint32_t value;			// Bytes of a weight, sizeof(real)
+	uint32_t layers;		// Number of layers
+	uint32_t width[MAX_LAYERS + 1];	// Inputs, then neurons of every layer
+	int32_t batch, hogwild, sync;	// Training mode of fashion-NN
+	int32_t epoch;			// Epochs of training
+	int32_t targetEpoch;	// Epoch the testing accuracy reached TARGET
+	int64_t steps;			// Training steps, samples or batches
+	double trainTime;		// Seconds of training
+	double targetTime;		// Training time when TARGET was reached, or -1
+	uint64_t seed;			// Seed of the training
+} CHECKPOINT;
+
+// NN layers, set at run time (-layers or a checkpoint). Layer l has
+// in inputs and out neurons, with a row of in + 1 weights per neuron
+// (the bias last) padded to ld values. The last layer is the output.
+typedef struct layer{
+	int in, out;			// Inputs and neurons
+	int ld;					// Values per row of weights
+	real *W;				// Weights
+} LAYER;
+static LAYER Layer[MAX_LAYERS];
+static int layers;			// Number of layers
+
+// Activations of the NN for rows samples: O[0] are the inputs,
+// O[l + 1] the outputs of layer l and D[l + 1] their deltas, in rows
+// of LD(l + 1) values. The outputs end with 0.5, the bias input of
+// the next layer.
+typedef struct work{
+	int rows;
+	real *O[MAX_LAYERS + 1];
+	real *D[MAX_LAYERS + 1];
+} WORK;
+#define LD(l) PAD((l) > 0 ? Layer[(l) - 1].out + 1 : Ninp + 1)
+
+// NN data, a row of the label and the pixels per sample
+typedef unsigned char SAMPLE[Ninp+1];
+static real Pixel[256];		// Normalized value of every pixel value
+
+// Fills the Pixel table, the pixels normalized in range (-1, 1)
+static inline void initPixels(){
+	for(int v = 0; v < 256; v++)
+		Pixel[v] = 2*(v/255.0)-1;
+}
+
+// Normalizes the pixels of a sample in range (-1, 1),
+// with the bias input last, into Ninp + 1 values of input
+static inline void inputRow(const unsigned char *sample, real *input){
+	for(int j = 0; j < Ninp; j++)
+		input[j] = Pixel[sample[j + 1]];
+	input[Ninp] = 1.0;
+}
+
+// Replaces the n values of a row with their sigmoid, 1 / (1 + e^-x),
+// vectorized. With -x = k ln2 + r, |r| <= ln2 / 2, e^-x is 2^k times
+// the Taylor polynomial of e^r of degree SIG_DEGREE. Measured by
+// -sigmoid over [-30, 30], the largest error against libm is 1.2e-7
+// in single precision and 2.2e-16 in double, an ulp of 1.
+// Needs AVX-512 (-march=native) to vectorize the integer conversion.
+static inline void sigmoidRow(real *out, int n){
+	static const real coef[SIG_DEGREE + 1] = {1, 1, 1. / 2, 1. / 6, 1. / 24, 1. / 120, 1. / 720
+#if SIG_DEGREE > 6
+		, 1. / 5040, 1. / 40320, 1. / 362880, 1. / 3628800, 1. / 39916800, 1. / 479001600
+#endif
+	};
+	#pragma omp simd
+	for(int i = 0; i < n; i++){
+		real x = -out[i];
+		x = x < -EXP_LIMIT ? -EXP_LIMIT : x > EXP_LIMIT ? EXP_LIMIT : x;
+		real k = (x * (real)M_LOG2E + ROUNDER) - ROUNDER;
+		// ln2 in two parts, so k ln2 has no rounding error
+		real r = x - k * (real)0.693145751953125 - k * (real)1.42860682030941723212e-6;
+		real p = coef[SIG_DEGREE];
+		for(int d = SIG_DEGREE - 1; d >= 0; d--)
+			p = p * r + coef[d];
+		union {realBits bits; real value;} scale = {((realBits)k + EXP_BIAS) << MANTISSA};
+		out[i] = 1 / (1 + p * scale.value);
+	}
+}
+
+// Dot product of the n values of a and b
+static inline __attribute__((always_inline)) real dotKernel(const real *a, const real *b, int n){
+	real sum = 0.0;
+	#pragma omp simd reduction(+:sum)
+	for(int j = 0; j < n; j++)
+		sum += a[j] * b[j];
+	return sum;
+}
+
+// dotKernel, specialized for the SPECIAL_WIDTHS
+static inline real dot(const real *a, const real *b, int n){
+	switch(n){
+#define DOT_CASE(k) case k: return dotKernel(a, b, k);
+	SPECIAL_WIDTHS(DOT_CASE)
+#undef DOT_CASE
+	default: return dotKernel(a, b, n);
+	}
+}
+
+// Kernels of the layers. The matrices are row-major
+// with leading dimensions lda, ldb, ldc.
+
+// C = A * B^T, for A of M x K and B of N x K. Tiles of 4 x 4 dot
+// products share the loads of their rows. The 4 rows of B stay in
+// L1 while the rows of A go by, and every tile sums its vectors
+// once, which costs as much as about 50 steps of its loop.
+static inline __attribute__((always_inline)) void gemmTile(int M, int N, int K, const real *A, int lda,
+                                                         const real *B, int ldb, real *C, int ldc){
+	for(int n = 0; n < N; n += 4){
+		// Past the edges the tiles repeat the last row, not stored
+		const real *b0 = B + (size_t)n * ldb;
+		const real *b1 = B + (size_t)(n + 1 < N ? n + 1 : N - 1) * ldb;
+		const real *b2 = B + (size_t)(n + 2 < N ? n + 2 : N - 1) * ldb;
+		const real *b3 = B + (size_t)(n + 3 < N ? n + 3 : N - 1) * ldb;
+		for(int m = 0; m < M; m += 4){
+			const real *a0 = A + (size_t)m * lda;
+			const real *a1 = A + (size_t)(m + 1 < M ? m + 1 : M - 1) * lda;
+			const real *a2 = A + (size_t)(m + 2 < M ? m + 2 : M - 1) * lda;
+			const real *a3 = A + (size_t)(m + 3 < M ? m + 3 : M - 1) * lda;
+			real c00 = 0, c01 = 0, c02 = 0, c03 = 0, c10 = 0, c11 = 0, c12 = 0, c13 = 0;
+			real c20 = 0, c21 = 0, c22 = 0, c23 = 0, c30 = 0, c31 = 0, c32 = 0, c33 = 0;
+			#pragma omp simd reduction(+:c00,c01,c02,c03,c10,c11,c12,c13,c20,c21,c22,c23,c30,c31,c32,c33)
+			for(int k = 0; k < K; k++){
+				real x0 = a0[k], x1 = a1[k], x2 = a2[k], x3 = a3[k];
+				real w0 = b0[k], w1 = b1[k], w2 = b2[k], w3 = b3[k];
+				c00 += x0 * w0; c01 += x0 * w1; c02 += x0 * w2; c03 += x0 * w3;
+				c10 += x1 * w0; c11 += x1 * w1; c12 += x1 * w2; c13 += x1 * w3;
+				c20 += x2 * w0; c21 += x2 * w1; c22 += x2 * w2; c23 += x2 * w3;
+				c30 += x3 * w0; c31 += x3 * w1; c32 += x3 * w2; c33 += x3 * w3;
+			}
+			real tile[4][4] = {{c00, c01, c02, c03}, {c10, c11, c12, c13},
+			                   {c20, c21, c22, c23}, {c30, c31, c32, c33}};
+			for(int i = 0; i < 4 && m + i < M; i++)
+				for(int j = 0; j < 4 && n + j < N; j++)
+					C[(size_t)(m + i) * ldc + n + j] = tile[i][j];
+		}
+	}
+}
+
+// gemmTile, specialized for the SPECIAL_WIDTHS
+static inline void gemmNT(int M, int N, int K, const real *A, int lda, const real *B, int ldb, real *C, int ldc){
+	switch(K){
+#define GEMM_CASE(k) case k: gemmTile(M, N, k, A, lda, B, ldb, C, ldc); return;
+	SPECIAL_WIDTHS(GEMM_CASE)
+#undef GEMM_CASE
+	default: gemmTile(M, N, K, A, lda, B, ldb, C, ldc);
+	}
+}
+
+// Applies the sigmoid to n outputs of every row
+static inline void sigmoidRows(real *out, int ld, int n, int count){
+	for(int m = 0; m < count; m++)
+		sigmoidRow(out + (size_t)m * ld, n);
+}
+
+// Activates the NN on the first count input rows
+// of w, on the calling thread
+static inline void forwardRows(WORK *w, int count){
+	for(int l = 0; l < layers; l++){
+		LAYER *L = &Layer[l];
+		gemmNT(count, L->out, L->in + 1, w->O[l], LD(l), L->W, L->ld, w->O[l + 1], LD(l + 1));
+		sigmoidRows(w->O[l + 1], LD(l + 1), L->out, count);
+	}
+}
+
+// Returns the size of the activations of rows samples
+static inline size_t workSize(int rows){
+	size_t size = LD(0);
+	for(int l = 1; l <= layers; l++)
+		size += 2 * LD(l);
+	return rows * size;
+}
+
+// Carves the activations of rows samples out of the arena at
+// *next, with the bias column of the outputs, and moves *next on
+static inline void carveWork(WORK *w, int rows, real **next){
+	w->rows = rows;
+	w->O[0] = *next;
+	*next += (size_t)rows * LD(0);
+	for(int l = 1; l <= layers; l++){
+		w->O[l] = *next;
+		w->D[l] = *next + (size_t)rows * LD(l);
+		*next += 2 * (size_t)rows * LD(l);
+		for(int m = 0; m < rows; m++)
+			w->O[l][(size_t)m * LD(l) + Layer[l - 1].out] = 0.5;
+	}
+}
+
+// Returns the class of a row of outputs, its most active neuron
+static inline int classify(const real *out){
+	int maxpos = 0;
+	for(int i = 1; i < NL2; i++)
+		if(out[i] > out[maxpos])
+			maxpos = i;
+	return maxpos;
+}
+
+// Returns the size of the weights of the layers
+static inline size_t weightSize(){
+	size_t size = 0;
+	for(int l = 0; l < layers; l++)
+		size += (size_t)Layer[l].out * Layer[l].ld;
+	return size;
+}
+
+// Maps a checkpoint file and sets up the layers from it, with
+// their weights in the mapping. Returns its header and stores
+// the size of the mapping in size.
+static inline CHECKPOINT *mapCheckpoint(const char *path, size_t *size){
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		perror("Unable to open the checkpoint");
+		exit(1);
+	}
+	*size = st.st_size;
+	CHECKPOINT *head = *size >= CHECKPOINT_OFFSET ? mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (head == MAP_FAILED || memcmp(head->magic, CHECKPOINT_MAGIC, 8) || head->version != CHECKPOINT_VERSION) {
+		fprintf(stderr, "%s: not a version %d checkpoint file\n", path, CHECKPOINT_VERSION);
+		exit(1);
+	}
+	if (head->value != sizeof(real)) {
+		fprintf(stderr, "%s: weights of %u bytes, this build has %zu (-DNN_FLOAT)\n", path, head->value, sizeof(real));
+		exit(1);
+	}
+	if (head->layers < 1 || head->layers > MAX_LAYERS || head->width[0] != Ninp || head->width[head->layers] != NL2) {
+		fprintf(stderr, "%s: not a network of %d inputs and %d outputs\n", path, Ninp, NL2);
+		exit(1);
+	}
+	layers = head->layers;
+	real *weights = (real *)((char *)head + CHECKPOINT_OFFSET);
+	for(int l = 0; l < layers; l++){
+		if (head->width[l + 1] < 1 || head->width[l + 1] > MAX_WIDTH) {
+			fprintf(stderr, "%s: layer %d of %u neurons\n", path, l + 1, head->width[l + 1]);
+			exit(1);
+		}
+		Layer[l].in = head->width[l];
+		Layer[l].out = head->width[l + 1];
+		Layer[l].ld = PAD(Layer[l].in + 1);
+		Layer[l].W = weights;
+		weights += (size_t)Layer[l].out * Layer[l].ld;
+	}
+	if (CHECKPOINT_OFFSET + weightSize() * sizeof(real) > *size) {
+		fprintf(stderr, "%s: truncated checkpoint file\n", path);
+		exit(1);
+	}
+	return head;
+}
+
+#endif
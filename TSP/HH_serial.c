@@ -1,8 +1,8 @@
 /* 
 Compiling: gcc HH_serial.c -o HH_serial -O2
-Executing: time ./HH_serial
+Executing: time ./HH_serial [cities file]
 Output:
-Minimum Distance = 2756252
+Minimum Distance = 2690734
 
 Time of execution:
 
@@ -16,6 +16,7 @@ sys     0m0,000s
 #include <stdbool.h>
 #include <limits.h>
 #include <string.h>
+#include "../common/dataset.h"
 
 #define N 1000		// Size of the grid
 #define NODES 10000	// Number of nodes
@@ -34,21 +35,17 @@ CITY Cities[NODES];		// Cities created
 short int Route[NODES];	// Indexes to Cities showing the route
 unsigned int currentDistance = 0;
 
-// Initialize the Cities array
-void createCities(){
-	bool coords[N][N];
-	memset(coords, true, N*N*sizeof(bool));
-	short int x, y;
+// Initialize the Cities array,
+// reading the cities from a cities file if one is given
+void createCities(char *path){
+	short int *xy = path ? loadCities(path, NODES) : generateCities(DATASET_SEED, NODES, N);
 	for (int i = 0; i < NODES; i++){
-		do{
-			x = rand() % N;
-			y = rand() % N;
-		} while(!coords[x][y]);
-		coords[x][y] = false;
-		Cities[i].x = x;
-		Cities[i].y = y;
+		Cities[i].x = xy[2*i];
+		Cities[i].y = xy[2*i+1];
 		Cities[i].available = true;
 	}
+	if(path == NULL)
+		free(xy);
 	Cities[0].available = false;
 }
 
@@ -100,7 +97,7 @@ int nearestNeighbour(int index){
 }
 
 int main(int argc, char *argv[]) {
-	createCities();
+	createCities(argc > 1 ? argv[1] : NULL);
 	Route[0] = 0;
 	unsigned int minDistance = UINT_MAX;
 	// Execute the algorithm REP times and hold the minimum distance
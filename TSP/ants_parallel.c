@@ -1,7 +1,7 @@
 /* 
 Compiling: gcc ants_parallel.c -o ants_parallel -O0 -lm -fopenmp
-Executing: time ./ants_parallel
-Output:
+Executing: time ./ants_parallel [cities file]
+Output (with the cities of the rand() generator used before common/dataset.h):
 Distance = 89706.076922
 
 Time of execution (on a 8-core linux system):
@@ -18,6 +18,7 @@ sys     0m4,942s
 #include <string.h>
 #include <math.h>
 #include <limits.h>
+#include "../common/dataset.h"
 
 // Problem parameters
 #define N 1000			// Size of the grid
@@ -56,39 +57,28 @@ float Distances[NODES][NODES];	// Distance between every city
 float T[NODES][NODES];			// Pheromone array
 ANT ants[NUM_OF_ANTS];			// Ants array
 
-// Initialize the global arrays
-void createData(){
-	bool coords[N][N];
-	memset(coords, true, N*N*sizeof(bool));
-	short int x, y;
+// Initialize the global arrays,
+// reading the cities from a cities file if one is given
+void createData(char *path){
+	short int *xy = path ? loadCities(path, NODES) : generateCities(DATASET_SEED, NODES, N);
 	for (int i = 0; i < NODES; i++){
-		do{
-			x = rand() % N;
-			y = rand() % N;
-		} while(!coords[x][y]);
-		coords[x][y] = false;
-		Cities[i].x = x;
-		Cities[i].y = y;
+		Cities[i].x = xy[2*i];
+		Cities[i].y = xy[2*i+1];
 	}
+	if(path == NULL)
+		free(xy);
 	
 	// Calculate distance between every other node
-	// and put the starting pheromone level an every edge
+	// and put the starting pheromone level an every edge.
+	// Whole rows at a time, as nodeDistance is symmetric
+	#pragma omp parallel for
 	for(int i = 0; i < NODES; i++){
-		for(int j = 0; j <= i; j++){
+		for(int j = 0; j < NODES; j++){
 			Distances[i][j] = nodeDistance(Cities[i], Cities[j]);
 			T[i][j] = 1.0;
 		}
 	}
 	
-	// Copy the upper triangle of 
-	// the arrays to the lower one
-	for(int i = 0; i < NODES; i++){
-		for(int j = i + 1; j < NODES; j++){
-			Distances[i][j] = Distances[j][i];
-			T[i][j] = 1.0;
-		}
-	}
-	
 	// Initialize every ant, on a random city
 	for(int i = 0; i < NUM_OF_ANTS; i++){
 		memset(ants[i].unvisited, true, NODES*sizeof(bool));
@@ -159,9 +149,9 @@ void evaporate(){
 			T[i][j] *= coeff;
 }
 
-int main() {
+int main(int argc, char *argv[]) {
 	#pragma omp threadprivate(seed)
-	createData();
+	createData(argc > 1 ? argv[1] : NULL);
 	double minTour;
 	for (int n = 0; n < REPS; n++){
 		// Ants complete their routes
@@ -1,9 +1,9 @@
 /* 
 Compiling: gcc random_swaps_parallel.c -o random_swaps_parallel -O2 -fopenmp
-Executing: time ./random_swaps_parallel
+Executing: time ./random_swaps_parallel [cities file]
 Output:
-Starting Distance = 3348790584
-Final Distance = 91334084
+Starting Distance = 3311014602
+Final Distance = 89531636
 
 Time of execution (on a 8-core linux system):
 
@@ -17,6 +17,7 @@ sys     0m3,603s
 #include <string.h>
 #include <stdbool.h>
 #include <omp.h>
+#include "../common/dataset.h"
 
 
 #define N 1000			// Size of the grid
@@ -33,20 +34,16 @@ typedef struct city{
 CITY Route[NODES];				// Depicts the current route
 unsigned int currentDistance;
 
-// Initialize the Route with cities
-void createCities(){
-	bool coords[N][N];
-	memset(coords, true, N*N*sizeof(bool));
-	short int x, y;
+// Initialize the Route with cities,
+// reading the cities from a cities file if one is given
+void createCities(char *path){
+	short int *xy = path ? loadCities(path, NODES) : generateCities(DATASET_SEED, NODES, N);
 	for (int i = 0; i < NODES; i++){
-		do{
-			x = rand() % N;
-			y = rand() % N;
-		} while(!coords[x][y]);
-		coords[x][y] = false;
-		Route[i].x = x;
-		Route[i].y = y;
+		Route[i].x = xy[2*i];
+		Route[i].y = xy[2*i+1];
 	}
+	if(path == NULL)
+		free(xy);
 }
 
 // Find the square of the euclidean distance between two nodes
@@ -100,7 +97,7 @@ void randomSwap(){
 }
 
 int main(int argc, char *argv[]) {
-	createCities();
+	createCities(argc > 1 ? argv[1] : NULL);
 	currentDistance = routeDistance();
 	printf("Starting Distance = %u\n", currentDistance);
 	for(int i = 0; i < SWAPS; i++)
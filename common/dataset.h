@@ -0,0 +1,296 @@
+/*
+Shared by the K-means, TSP and NN programs.
+
+The random data comes from a counter based generator (Philox4x32-10):
+every value depends only on the seed and its index, so the data can be
+created in parallel and is identical for any number of threads.
+
+The binary dataset files have a DATASET header and then the rows,
+starting at DATASET_OFFSET. K-means samples are rows of floats padded
+to 64 bytes, TSP cities are rows of two short int coordinates and
+Fashion-MNIST images are rows of bytes, the label and the pixels as in
+the csv files. The files
+are memory mapped, so loading them runs at the speed of the disk.
+Files are created by the programs themselves or by mkdataset.c.
+*/
+
+#ifndef DATASET_H
+#define DATASET_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// *************************************
+#define DATASET_MAGIC "OMPMLSET"
+#define DATASET_VERSION 1
+#define DATASET_OFFSET 64 // Offset of the rows in the file
+#define DATASET_SEED 1    // Default seed of the generated data
+
+// Types of rows
+#define DATASET_FLOAT 1 // K-means samples
+#define DATASET_SHORT 2 // TSP city coordinates
+#define DATASET_BYTE 3  // Labels and pixels of the NN images
+
+typedef struct dataset{
+    char magic[8];    // DATASET_MAGIC
+    uint32_t version; // DATASET_VERSION
+    uint32_t type;    // DATASET_FLOAT, DATASET_SHORT or DATASET_BYTE
+    uint64_t rows;    // Number of samples or cities
+    uint32_t dims;    // Values of every row
+    uint32_t stride;  // Values per row, including the padding
+    uint64_t seed;    // Seed the rows were generated with
+} DATASET;
+
+// The rows of a mapped dataset
+#define DATASET_ROWS(head) ((void *)((char *)(head) + DATASET_OFFSET))
+
+// *************************************
+// Philox4x32-10: encrypts the 128 bit counter ctr with
+// the 64 bit key, giving four random 32 bit numbers
+static inline void philox(uint32_t ctr[4], uint64_t key)
+{
+    uint32_t k0 = key, k1 = key >> 32;
+    for (int round = 0; round < 10; round++)
+    {
+        uint64_t p0 = (uint64_t)0xD2511F53 * ctr[0], p1 = (uint64_t)0xCD9E8D57 * ctr[2];
+        uint32_t c1 = ctr[1], c3 = ctr[3];
+        ctr[0] = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        ctr[1] = (uint32_t)p1;
+        ctr[2] = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        ctr[3] = (uint32_t)p0;
+        k0 += 0x9E3779B9;
+        k1 += 0xBB67AE85;
+    }
+}
+
+// *************************************
+// Sets out to the four random 32 bit numbers of
+// counter of stream seed, numbers 4 * counter on
+static inline void randomUint4(uint64_t seed, uint64_t counter, uint32_t out[4])
+{
+    out[0] = (uint32_t)counter;
+    out[1] = (uint32_t)(counter >> 32);
+    out[2] = out[3] = 0;
+    philox(out, seed);
+}
+
+// *************************************
+// Returns random 32 bit number index of stream seed
+static inline uint32_t randomUint(uint64_t seed, uint64_t index)
+{
+    uint32_t ctr[4];
+    randomUint4(seed, index / 4, ctr);
+    return ctr[index % 4];
+}
+
+// *************************************
+// Returns a uniform number in [0, 1) from 32 random bits
+static inline float uniformBits(uint32_t bits)
+{
+    return (bits >> 8) * (1.0f / (1 << 24));
+}
+
+// *************************************
+// Returns a uniform number in [0, 1), number index of stream seed
+static inline float randomUniform(uint64_t seed, uint64_t index)
+{
+    return uniformBits(randomUint(seed, index));
+}
+
+// *************************************
+// Returns value index of the K-means samples of stream
+// seed, in the range (-2, 2) for every dimension
+static inline float randomSample(uint64_t seed, uint64_t index)
+{
+    return 4 * (randomUniform(seed, index) - 0.5f);
+}
+
+// *************************************
+// Sets x to the count values of the K-means samples of stream
+// seed from value index on, the same as randomSample(), but
+// using all four numbers of every Philox block
+static inline void randomSamples(uint64_t seed, uint64_t index, size_t count, float *x)
+{
+    uint32_t block[4];
+    for (size_t t = 0; t < count; t++)
+    {
+        uint64_t v = index + t;
+        if (t == 0 || v % 4 == 0)
+            randomUint4(seed, v / 4, block);
+        x[t] = 4 * (uniformBits(block[v % 4]) - 0.5f);
+    }
+}
+
+// *************************************
+// Returns the size of the values of a type of rows
+static inline size_t datasetValue(uint32_t type)
+{
+    return type == DATASET_FLOAT ? sizeof(float) : type == DATASET_SHORT ? sizeof(short) : 1;
+}
+
+// *************************************
+// Checks the header of a dataset file of the given
+// type and returns what is wrong with it, or NULL
+static inline const char *checkDataset(const DATASET *head, uint32_t type)
+{
+    if (memcmp(head->magic, DATASET_MAGIC, 8))
+        return "not a dataset file";
+    if (head->version != DATASET_VERSION)
+        return "unsupported dataset version";
+    if (head->type != type)
+        return "wrong type of dataset";
+    if (head->dims == 0 || head->stride < head->dims)
+        return "bad dimensions";
+    return NULL;
+}
+
+// *************************************
+// Maps a dataset file of the given type and returns its header,
+// followed by its rows. Stores the size of the mapping in size.
+static inline DATASET *mapDataset(const char *path, uint32_t type, size_t *size)
+{
+    DATASET *head;
+    const char *error;
+    struct stat st;
+    size_t value = datasetValue(type);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        perror("Unable to open the dataset");
+        exit(1);
+    }
+    if ((size_t)st.st_size < DATASET_OFFSET)
+    {
+        fprintf(stderr, "%s: not a dataset file\n", path);
+        exit(1);
+    }
+    *size = st.st_size;
+    head = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (head == MAP_FAILED)
+    {
+        perror("Unable to map the dataset");
+        exit(1);
+    }
+    if ((error = checkDataset(head, type)) != NULL)
+    {
+        fprintf(stderr, "%s: %s\n", path, error);
+        exit(1);
+    }
+    if (head->rows > (*size - DATASET_OFFSET) / value / head->stride)
+    {
+        fprintf(stderr, "%s: truncated dataset file\n", path);
+        exit(1);
+    }
+    return head;
+}
+
+// *************************************
+// Writes a dataset file with the rows and the type, size and seed
+// of head. Returns 0, with errno set, when the file cannot be
+// created or written, and then removes what was written.
+static inline int tryWriteDataset(const char *path, DATASET head, const void *rows)
+{
+    char pad[DATASET_OFFSET] = {0};
+    size_t value = datasetValue(head.type);
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL)
+        return 0;
+    memcpy(head.magic, DATASET_MAGIC, 8);
+    head.version = DATASET_VERSION;
+    memcpy(pad, &head, sizeof(head));
+    int written = fwrite(pad, 1, DATASET_OFFSET, fp) == DATASET_OFFSET &&
+                  fwrite(rows, value * head.stride, head.rows, fp) == head.rows;
+    if (fclose(fp) || !written)
+    {
+        int error = errno;
+        remove(path);
+        errno = error;
+        return 0;
+    }
+    return 1;
+}
+
+// *************************************
+// Writes a dataset file with the rows and the
+// type, size and seed of head, or exits
+static inline void writeDataset(const char *path, DATASET head, const void *rows)
+{
+    if (!tryWriteDataset(path, head, rows))
+    {
+        perror("Unable to write the dataset");
+        exit(1);
+    }
+}
+
+// *************************************
+// Creates nodes cities on distinct points of a grid x grid
+// square and returns their x, y coordinates. Every city draws
+// its point in parallel and the cities whose point was taken
+// by a city with a lower index draw again, in rounds.
+static inline short *generateCities(uint64_t seed, int nodes, int grid)
+{
+    long cells = (long)grid * grid;
+    short *xy = malloc(2 * nodes * sizeof(short));
+    int *pending = malloc(nodes * sizeof(int)), left = nodes;
+    long *cell = malloc(nodes * sizeof(long));
+    char *taken = calloc(cells, 1);
+    if (xy == NULL || pending == NULL || cell == NULL || taken == NULL || nodes > cells)
+    {
+        fprintf(stderr, "Unable to create %d cities on a %d x %d grid\n", nodes, grid, grid);
+        exit(1);
+    }
+    for (int i = 0; i < nodes; i++)
+        pending[i] = i;
+    for (uint64_t round = 0; left > 0; round++)
+    {
+        int next = 0;
+        // Serial for the programs built without OpenMP
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static)
+#endif
+        for (int p = 0; p < left; p++)
+            cell[p] = randomUint(seed, round << 32 | pending[p]) * (uint64_t)cells >> 32;
+        // In order of index, so the result does not depend on the threads
+        for (int p = 0; p < left; p++)
+        {
+            if (taken[cell[p]])
+            {
+                pending[next++] = pending[p];
+                continue;
+            }
+            taken[cell[p]] = 1;
+            xy[2 * pending[p]] = cell[p] / grid;
+            xy[2 * pending[p] + 1] = cell[p] % grid;
+        }
+        left = next;
+    }
+    free(pending);
+    free(cell);
+    free(taken);
+    return xy;
+}
+
+// *************************************
+// Returns the x, y coordinates of the cities of a dataset
+// file, which must hold the given number of cities
+static inline short *loadCities(const char *path, int nodes)
+{
+    size_t size;
+    DATASET *head = mapDataset(path, DATASET_SHORT, &size);
+    if (head->rows != (uint64_t)nodes || head->dims != 2 || head->stride != 2)
+    {
+        fprintf(stderr, "%s: not a file of %d cities\n", path, nodes);
+        exit(1);
+    }
+    return DATASET_ROWS(head);
+}
+
+#endif
@@ -0,0 +1,85 @@
+/*
+Compiling: gcc mkdataset.c -o mkdataset -O3 -fopenmp
+Executing: time ./mkdataset kmeans file [samples [dimensions [seed]]]
+           time ./mkdataset cities file [nodes [grid [seed]]]
+Writes a dataset file (see dataset.h) with the data the programs
+create themselves:
+    kmeans   samples for kmeans_serial/parallel -data (default 100000
+             samples of 1000 dimensions)
+    cities   cities for the TSP programs (default 10000 nodes on a
+             1000 x 1000 grid)
+The default seed is DATASET_SEED. The data is the same for any
+number of threads.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "dataset.h"
+
+#define ALIGN 64 // Padding of the K-means rows, as in kmeans_parallel
+
+// *************************************
+void writeSamples(char *path, long samples, int dims, uint64_t seed);
+void writeCities(char *path, int nodes, int grid, uint64_t seed);
+void usage(char *name);
+
+// *************************************
+// Creates the K-means samples in parallel and writes them
+void writeSamples(char *path, long samples, int dims, uint64_t seed)
+{
+    int stride = (dims * sizeof(float) + ALIGN - 1) / ALIGN * ALIGN / sizeof(float);
+    float *rows = calloc((size_t)samples * stride, sizeof(float));
+    if (rows == NULL)
+    {
+        perror("Unable to allocate the samples");
+        exit(1);
+    }
+    #pragma omp parallel for schedule(static)
+    for (long i = 0; i < samples; i++)
+        randomSamples(seed, (size_t)i * dims, dims, &rows[i * stride]);
+    DATASET head = {.type = DATASET_FLOAT, .rows = samples, .dims = dims, .stride = stride, .seed = seed};
+    writeDataset(path, head, rows);
+    free(rows);
+}
+
+// *************************************
+// Creates the TSP cities and writes them
+void writeCities(char *path, int nodes, int grid, uint64_t seed)
+{
+    short *xy = generateCities(seed, nodes, grid);
+    DATASET head = {.type = DATASET_SHORT, .rows = nodes, .dims = 2, .stride = 2, .seed = seed};
+    writeDataset(path, head, xy);
+    free(xy);
+}
+
+// *************************************
+// Prints the available options
+void usage(char *name)
+{
+    fprintf(stderr, "Usage: %s kmeans file [samples [dimensions [seed]]]\n"
+                    "       %s cities file [nodes [grid [seed]]]\n", name, name);
+    exit(1);
+}
+
+// *************************************
+int main(int argc, char *argv[])
+{
+    double start = omp_get_wtime();
+    if (argc < 3 || argc > 6)
+        usage(argv[0]);
+    long count = argc > 3 ? atol(argv[3]) : 0;
+    int size = argc > 4 ? atoi(argv[4]) : 0;
+    uint64_t seed = argc > 5 ? strtoull(argv[5], NULL, 0) : DATASET_SEED;
+    if (count < 0 || size < 0)
+        usage(argv[0]);
+    if (!strcmp(argv[1], "kmeans"))
+        writeSamples(argv[2], count ? count : 100000, size ? size : 1000, seed);
+    else if (!strcmp(argv[1], "cities"))
+        writeCities(argv[2], count ? count : 10000, size ? size : 1000, seed);
+    else
+        usage(argv[0]);
+    printf("Written in %.3f s\n", omp_get_wtime() - start);
+    return 0;
+}